@@ -0,0 +1,176 @@
+/*
+ * addon.cpp
+ *
+ * Node.js addon with the hain(points) of hain.js, decomposing by
+ * fillPoly(). hain.js exports it in place of the JS version where it is
+ * built. points is an array of [x, y] as for hain.js, or else the x and
+ * y of each point in turn in a Float32Array or Float64Array, which is
+ * decomposed in place if its type is that of Coord. Returns the number of
+ * wedge sequences.
+ *
+ * Built by node-gyp (binding.gyp) with the headers of the node run
+ *
+ *   node-gyp rebuild --nodedir=/usr
+ *
+ * or without it
+ *
+ *   g++ -O2 -shared -fPIC -I/usr/include/node -o build/Release/hain.node addon.cpp hain.cpp
+ *
+ * Fixed-point coordinates are taken in pixels.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <node_api.h>
+#include "hain.h"
+
+/* pixel coordinate d as a Coord */
+#ifdef FIXED_COORDS
+#define COORD(d) ((Coord)floor((d) * (1 << FIXED_SHIFT) + .5))
+#else
+#define COORD(d) ((Coord)(d))
+#endif
+
+/* The typed array that holds Points as they are */
+#if defined(FIXED_COORDS)
+#define POINT_ARRAY ((napi_typedarray_type)-1)
+#elif defined(DOUBLE_COORDS)
+#define POINT_ARRAY napi_float64_array
+#else
+#define POINT_ARRAY napi_float32_array
+#endif
+
+typedef struct {
+    FillContext fc; /* kept between calls, to reuse its buffers */
+    Point *v; /* points copied from the argument */
+    int maxV;
+} Addon;
+
+static void freeAddon(napi_env env, void *data, void *hint)
+{
+    Addon *a = (Addon*)data;
+
+    (void)env;
+    (void)hint;
+    freeFillContext(&a->fc);
+    free(a->v);
+    free(a);
+}
+/*-------------------------------------------------------*/
+static Point *addonPoints(Addon *a, int n)
+{
+/* Room for n points in a->v, or NULL if out of memory */
+    Point *v;
+
+    if (n > a->maxV) {
+        v = (Point*) realloc(a->v, n * sizeof(Point));
+        if (!v) return NULL;
+        a->v = v;
+        a->maxV = n;
+    }
+    return a->v;
+}
+/*-------------------------------------------------------*/
+static napi_value outOfMemory(napi_env env)
+{
+    napi_throw_error(env, NULL, "hain(): out of memory");
+    return NULL;
+}
+/*-------------------------------------------------------*/
+static napi_value hain(napi_env env, napi_callback_info info)
+{
+/* hain(points) */
+    Addon *a;
+    Point *v = NULL;
+    napi_value arg, p, c, result;
+    napi_typedarray_type type;
+    napi_valuetype valueType;
+    bool isArray, isTyped;
+    size_t argc = 1, length;
+    uint32_t i, n;
+    void *data;
+    double x, y;
+    int numbWs;
+
+    if (napi_get_cb_info(env, info, &argc, &arg, NULL, (void**)&a) != napi_ok) return NULL;
+    if (argc < 1) {
+        napi_throw_type_error(env, NULL, "hain() takes an array of points");
+        return NULL;
+    }
+    napi_is_typedarray(env, arg, &isTyped);
+    napi_is_array(env, arg, &isArray);
+
+    if (isTyped) {
+        napi_get_typedarray_info(env, arg, &type, &length, &data, NULL, NULL);
+        n = (uint32_t)(length / 2);
+        if (type == POINT_ARRAY) v = (Point*)data;
+        else if (type == napi_float32_array || type == napi_float64_array) {
+            if (!(v = addonPoints(a, n))) return outOfMemory(env);
+            for (i = 0; i < n; i++) {
+                if (type == napi_float32_array) {
+                    v[i].x = COORD(((float*)data)[2*i]);
+                    v[i].y = COORD(((float*)data)[2*i+1]);
+                }
+                else {
+                    v[i].x = COORD(((double*)data)[2*i]);
+                    v[i].y = COORD(((double*)data)[2*i+1]);
+                }
+            }
+        }
+        else {
+            napi_throw_type_error(env, NULL, "hain() takes a Float32Array or Float64Array");
+            return NULL;
+        }
+    }
+    else if (isArray) {
+        napi_get_array_length(env, arg, &n);
+        if (!(v = addonPoints(a, n))) return outOfMemory(env);
+        for (i = 0; i < n; i++) {
+            napi_get_element(env, arg, i, &p);
+            napi_typeof(env, p, &valueType);
+            if (valueType != napi_object || napi_get_element(env, p, 0, &c) != napi_ok ||
+                napi_get_value_double(env, c, &x) != napi_ok ||
+                napi_get_element(env, p, 1, &c) != napi_ok ||
+                napi_get_value_double(env, c, &y) != napi_ok) {
+                napi_throw_type_error(env, NULL, "hain() takes points as [x, y]");
+                return NULL;
+            }
+            v[i].x = COORD(x);
+            v[i].y = COORD(y);
+        }
+    }
+    else {
+        napi_throw_type_error(env, NULL, "hain() takes an array of points");
+        return NULL;
+    }
+
+    numbWs = (n < 3)? 0: fillPoly(&a->fc, (int)n, v);
+    if (numbWs < 0) return outOfMemory(env);
+    napi_create_int32(env, numbWs, &result);
+    return result;
+}
+/*-------------------------------------------------------*/
+static napi_value init(napi_env env, napi_value exports)
+{
+/* module.exports = hain, as for hain.js */
+    Addon *a;
+    napi_value f;
+
+    (void)exports; /* replaced by f */
+    a = (Addon*) malloc(sizeof(Addon));
+    if (!a) {
+        napi_throw_error(env, NULL, "hain: out of memory");
+        return NULL;
+    }
+    initFillContext(&a->fc);
+    a->v = NULL;
+    a->maxV = 0;
+    if (napi_set_instance_data(env, a, freeAddon, NULL) != napi_ok) {
+        freeAddon(env, a, NULL);
+        return NULL;
+    }
+    napi_create_function(env, "hain", NAPI_AUTO_LENGTH, hain, a, &f);
+    return f;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
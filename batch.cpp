@@ -0,0 +1,411 @@
+/*
+ * batch.cpp
+ *
+ * Decompose many polygons on several threads
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include "hain.h"
+
+/* The polygons [lo, hi) a worker has not started yet, packed in one word so
+ * the owner (taking from lo) and thieves (splitting off the top) can both
+ * update it with a single compare-and-swap. */
+#define RANGE(lo, hi) (((unsigned long long)(unsigned)(hi) << 32) | (unsigned)(lo))
+#define RANGE_LO(r) ((int)((r) & 0xffffffffu))
+#define RANGE_HI(r) ((int)((r) >> 32))
+
+typedef struct {
+    std::atomic<unsigned long long> range; /* polygons left to do */
+    FillContext fc; /* wedge sequences of all polygons done by this worker */
+    int status; /* -1 if fc ran out of memory */
+    Point slabMin, slabMax; /* slab of fillSlabs(), within the bounding box and clip rectangle */
+} Worker;
+
+typedef struct {
+    Worker *workers;
+    int numbWorkers;
+    int numbPolys; /* polygons, or rings of the one polygon of fillSlabs() */
+    Point *v;
+    const int *ringOffsets;
+    int *polyWorker; /* worker that decomposed polygon k */
+    int *polyWs; /* first wedge sequence of polygon k in that worker's fc */
+    int *wsOffsets; /* wedge sequence counts (at k+1), then offsets */
+    int *weOffsets; /* likewise for wedge elements */
+    FillContext *fc; /* output */
+} Batch;
+
+static int splitRange(const Batch *b, int lo, int hi, int num, int den)
+{
+/* First polygon of [lo, hi) at or beyond num/den of its vertices.
+ * The result lies in [lo, hi-1], so the top part is never empty. */
+    const int *ro = b->ringOffsets;
+    int target = ro[lo] + (int)((long long)(ro[hi] - ro[lo]) * num / den);
+    int mid = (int)(std::lower_bound(ro + lo + 1, ro + hi, target) - ro);
+
+    return (mid < hi)? mid: hi - 1;
+}
+/*-------------------------------------------------------*/
+static int takePoly(Worker *w)
+{
+/* Take the next polygon of a worker's own range. Returns -1 if empty. */
+    unsigned long long r = w->range.load();
+
+    do {
+        if (RANGE_LO(r) >= RANGE_HI(r)) return -1;
+    } while (!w->range.compare_exchange_weak(r, RANGE(RANGE_LO(r) + 1, RANGE_HI(r))));
+    return RANGE_LO(r);
+}
+/*-------------------------------------------------------*/
+static int stealPolys(Batch *b, int self)
+{
+/* Move the top half (by vertex count) of the largest range left to the
+ * worker self. Returns 0 if no work is left anywhere. */
+    Worker *victim;
+    unsigned long long r;
+    int i, lo, hi, mid, best;
+
+    for (;;) {
+        victim = NULL;
+        for (best = 0, i = 0; i < b->numbWorkers; i++) {
+            r = b->workers[i].range.load();
+            if (RANGE_HI(r) - RANGE_LO(r) > best) {
+                best = RANGE_HI(r) - RANGE_LO(r);
+                victim = &b->workers[i];
+            }
+        }
+        if (!victim) return 0;
+
+        r = victim->range.load();
+        lo = RANGE_LO(r);
+        hi = RANGE_HI(r);
+        if (lo >= hi) continue;
+        mid = splitRange(b, lo, hi, 1, 2);
+        if (victim->range.compare_exchange_strong(r, RANGE(lo, mid))) {
+            b->workers[self].range.store(RANGE(mid, hi));
+            return 1;
+        }
+    }
+}
+/*-------------------------------------------------------*/
+static void decomposePolys(Batch *b, int self)
+{
+    Worker *w = &b->workers[self];
+    int k, numbWs, firstWe;
+
+    for (;;) {
+        if ((k = takePoly(w)) < 0) {
+            if (!stealPolys(b, self)) break;
+            continue;
+        }
+        b->polyWorker[k] = self;
+        b->polyWs[k] = w->fc.numbWs;
+        firstWe = w->fc.numbWe;
+        numbWs = appendPoly(&w->fc, b->ringOffsets[k+1] - b->ringOffsets[k],
+                            b->v + b->ringOffsets[k]);
+        if (numbWs == -2) numbWs = 0; /* edges cross (with cleanInput): nothing added */
+        else if (numbWs < 0) {
+            /* drop the partial output of this polygon */
+            w->status = -1;
+            w->fc.numbWs = b->polyWs[k];
+            w->fc.numbWe = firstWe;
+            numbWs = 0;
+        }
+        b->wsOffsets[k+1] = numbWs;
+        b->weOffsets[k+1] = w->fc.numbWe - firstWe;
+    }
+}
+/*-------------------------------------------------------*/
+static void copyPolys(Batch *b, int self)
+{
+/* Copy the output of this worker's share of the polygons (by index, not
+ * by who decomposed them) to the output context. */
+    FillContext *src;
+    WedgeSequence *ws;
+    int k, i, numbWs, srcWe,
+        kmin = (int)((long long)b->numbPolys * self / b->numbWorkers),
+        kmax = (int)((long long)b->numbPolys * (self + 1) / b->numbWorkers);
+
+    for (k = kmin; k < kmax; k++) {
+        numbWs = b->wsOffsets[k+1] - b->wsOffsets[k];
+        if (numbWs == 0) continue;
+        src = &b->workers[b->polyWorker[k]].fc;
+        ws = b->fc->ws + b->wsOffsets[k];
+        memcpy(ws, src->ws + b->polyWs[k], numbWs * sizeof(WedgeSequence));
+        srcWe = ws[0].firstWe;
+        memcpy(b->fc->we + b->weOffsets[k], src->we + srcWe,
+               (b->weOffsets[k+1] - b->weOffsets[k]) * sizeof(WedgeElement));
+        for (i = 0; i < numbWs; i++) ws[i].firstWe += b->weOffsets[k] - srcWe;
+    }
+}
+/*-------------------------------------------------------*/
+static void decomposeSlab(Batch *b, int self)
+{
+/* Decompose the part of the polygon in slab self, as clipped to it (see
+ * appendClipped). The slabs on either side of a side cut the rings at
+ * the same points, as they cut the same edges the same way. */
+    Worker *w = &b->workers[self];
+
+    w->fc.clip = 1;
+    w->fc.clipMin = w->slabMin;
+    w->fc.clipMax = w->slabMax;
+    if (fillRings(&w->fc, b->numbPolys, b->v, b->ringOffsets) < 0) w->status = -1;
+}
+/*-------------------------------------------------------*/
+static void copySlab(Batch *b, int self)
+{
+/* Copy the output of worker self to its place in the output context */
+    FillContext *src = &b->workers[self].fc;
+    WedgeSequence *ws = b->fc->ws + b->wsOffsets[self];
+    int i;
+
+    memcpy(ws, src->ws, src->numbWs * sizeof(WedgeSequence));
+    memcpy(b->fc->we + b->weOffsets[self], src->we, src->numbWe * sizeof(WedgeElement));
+    for (i = 0; i < src->numbWs; i++) ws[i].firstWe += b->weOffsets[self];
+}
+/*-------------------------------------------------------*/
+static void runWorkers(Batch *b, void (*work)(Batch*, int))
+{
+    std::thread *threads = new std::thread[b->numbWorkers];
+    int i;
+
+    for (i = 1; i < b->numbWorkers; i++) threads[i] = std::thread(work, b, i);
+    work(b, 0);
+    for (i = 1; i < b->numbWorkers; i++) threads[i].join();
+    delete[] threads;
+}
+/*-------------------------------------------------------*/
+int fillPolys(FillContext *fc, int numbPolys, Point v[], const int ringOffsets[],
+              int wsOffsets[], int numbThreads)
+{
+/*----------------------------------------------
+ * Decompose polygon k = v[ringOffsets[k] .. ringOffsets[k+1]-1] for every
+ * k < numbPolys, using numbThreads threads (all cores if <= 0).
+ *
+ * Each polygon is decomposed exactly as by fillPoly(). Its wedge sequences
+ * are left in fc->ws[wsOffsets[k] .. wsOffsets[k+1]-1], with all wedge
+ * elements in the one fc->we buffer. wsOffsets must have numbPolys+1
+ * entries. fc->sink and fc->triangulate are not used; with fc->cleanInput,
+ * a polygon whose edges cross or touch gets no wedge sequences. Polygons
+ * are filled by fc->fillRule, and clipped if fc->clip is set.
+ *
+ * Polygons are handed out in ranges of about equal vertex count; a worker
+ * that runs out steals the top half of the largest range left.
+ *
+ * Returns the total number of wedge sequences, or -1 if out of memory.
+ */
+    Batch b;
+    int i, k, lo, hi, status = 0;
+
+    fc->numbWs = fc->numbWe = 0;
+    wsOffsets[0] = 0;
+    if (numbThreads <= 0) numbThreads = (int)std::thread::hardware_concurrency();
+    if (numbThreads > numbPolys) numbThreads = numbPolys;
+    if (numbThreads < 1) numbThreads = 1;
+
+    b.workers = new Worker[numbThreads];
+    b.numbWorkers = numbThreads;
+    b.numbPolys = numbPolys;
+    b.v = v;
+    b.ringOffsets = ringOffsets;
+    b.polyWorker = (int*) malloc(numbPolys * sizeof(int));
+    b.polyWs = (int*) malloc(numbPolys * sizeof(int));
+    b.wsOffsets = wsOffsets;
+    b.weOffsets = (int*) malloc((numbPolys + 1) * sizeof(int));
+    b.fc = fc;
+
+    if (numbPolys && (!b.polyWorker || !b.polyWs || !b.weOffsets)) status = -1;
+    for (i = 0, lo = 0; i < numbThreads; i++, lo = hi) {
+        initFillContext(&b.workers[i].fc);
+        b.workers[i].fc.cleanInput = fc->cleanInput;
+        b.workers[i].fc.fillRule = fc->fillRule;
+        b.workers[i].fc.clip = fc->clip;
+        b.workers[i].fc.clipMin = fc->clipMin;
+        b.workers[i].fc.clipMax = fc->clipMax;
+        b.workers[i].fc.tolerance = fc->tolerance;
+        b.workers[i].status = 0;
+        hi = (i == numbThreads - 1)? numbPolys: splitRange(&b, 0, numbPolys, i + 1, numbThreads);
+        b.workers[i].range.store(RANGE(lo, hi));
+    }
+
+    if (!status) {
+        runWorkers(&b, decomposePolys);
+        for (i = 0; i < numbThreads; i++) status |= b.workers[i].status;
+    }
+
+    if (!status) {
+        b.weOffsets[0] = 0;
+        for (k = 0; k < numbPolys; k++) {
+            wsOffsets[k+1] += wsOffsets[k];
+            b.weOffsets[k+1] += b.weOffsets[k];
+        }
+        if (reserveWedges(fc, wsOffsets[numbPolys] + 1, b.weOffsets[numbPolys])) status = -1;
+    }
+
+    if (!status) {
+        runWorkers(&b, copyPolys);
+        fc->numbWs = wsOffsets[numbPolys];
+        fc->numbWe = b.weOffsets[numbPolys];
+        fc->ws[fc->numbWs].opcode = END;
+    }
+
+    for (i = 0; i < numbThreads; i++) freeFillContext(&b.workers[i].fc);
+    delete[] b.workers;
+    free(b.polyWorker);
+    free(b.polyWs);
+    free(b.weOffsets);
+    return status? -1: fc->numbWs;
+}
+/*-------------------------------------------------------*/
+int fillSlabs(FillContext *fc, int numbRings, Point v[], const int ringOffsets[], int numbThreads)
+{
+/*----------------------------------------------
+ * As fillRings(), for one large polygon, using numbThreads threads (all
+ * cores if <= 0). The polygon is cut into as many vertical slabs, of
+ * about the same number of vertices, and each thread decomposes the
+ * part in one slab, as clipped to it (see appendClipped). The wedge
+ * sequences of each slab follow the ones of the slab left of it in
+ * fc->ws.
+ *
+ * A wedge sequence that would cross the side of a slab is cut in two
+ * there, and the halves are not put back together: a wedge sequence has
+ * one left and one right side, and the halves are side by side, so one
+ * made of them would have to be decomposed again across the side. That
+ * makes one more wedge sequence for each monotone piece a side crosses,
+ * as many as the edges it crosses over two, at most.
+ *
+ * fc->sink and fc->triangulate are not used. With fc->clip, only the
+ * part in the clip rectangle is decomposed.
+ *
+ * The slab sides are picked from a sample of the vertices, then put half
+ * way between the vertices next to them in one pass over all of them,
+ * so that cutting at a side makes no needlessly short edges; there may
+ * be fewer slabs if two sides meet. Besides its slab, each thread takes
+ * a pass over all vertices. Returns the number of wedge sequences, or -1
+ * if out of memory.
+ */
+    Batch b;
+    Worker *w;
+    Coord *xs, *sides, *below, *above, xmin, xmax, ymin, ymax;
+    int i, k, step, numbXs, status = 0, n = ringOffsets[numbRings];
+
+    if (numbThreads <= 0) numbThreads = (int)std::thread::hardware_concurrency();
+    if (numbThreads > n / 64) numbThreads = n / 64; /* not worth a thread */
+    if (numbThreads <= 1) return fillRings(fc, numbRings, v, ringOffsets);
+
+    /* side i of the slabs at the (i*numbXs/numbThreads)-th of about 1024
+     * of the x, in order, and within the clip rectangle */
+    step = n / 1024 + 1;
+    xs = (Coord*) malloc((n / step + 1) * sizeof(Coord));
+    sides = (Coord*) malloc(3 * (numbThreads + 1) * sizeof(Coord));
+    if (!xs || !sides) {
+        free(xs);
+        free(sides);
+        return -1;
+    }
+    below = sides + numbThreads + 1;
+    above = below + numbThreads + 1;
+    for (i = 0, numbXs = 0; i < n; i += step) xs[numbXs++] = v[i].x;
+    std::sort(xs, xs + numbXs);
+    for (i = 1; i < numbThreads; i++) {
+        sides[i] = xs[i*numbXs/numbThreads];
+        if (fc->clip) sides[i] = std::min(std::max(sides[i], fc->clipMin.x), fc->clipMax.x);
+        below[i] = std::numeric_limits<Coord>::lowest();
+        above[i] = std::numeric_limits<Coord>::max();
+    }
+    free(xs);
+    numbThreads = (int)(std::unique(sides + 1, sides + numbThreads) - sides);
+
+    /* The bounding box, and the x of the vertices next to each side. A
+     * side then goes half way between them, away from the vertices, or is
+     * dropped if there is no room. */
+    xmin = xmax = v[0].x;
+    ymin = ymax = v[0].y;
+    for (i = 0; i < n; i++) {
+        if (v[i].x < xmin) xmin = v[i].x;
+        if (v[i].x > xmax) xmax = v[i].x;
+        if (v[i].y < ymin) ymin = v[i].y;
+        if (v[i].y > ymax) ymax = v[i].y;
+        k = (int)(std::lower_bound(sides + 1, sides + numbThreads, v[i].x) - sides);
+        if (k < numbThreads && v[i].x > below[k]) below[k] = v[i].x;
+        if (k > 1 && v[i].x < above[k-1]) above[k-1] = v[i].x;
+    }
+    for (i = k = 1; i < numbThreads; i++) {
+        if (below[i] == std::numeric_limits<Coord>::lowest() ||
+            above[i] == std::numeric_limits<Coord>::max()) continue;
+        sides[k] = below[i] + (above[i] - below[i]) / 2;
+        if (sides[k] > below[i] && sides[k] < above[i]) k++;
+    }
+    numbThreads = k;
+    if (numbThreads <= 1) {
+        free(sides);
+        return fillRings(fc, numbRings, v, ringOffsets);
+    }
+    sides[0] = xmin;
+    sides[numbThreads] = xmax;
+    if (fc->clip) {
+        xmin = std::max(xmin, fc->clipMin.x);
+        xmax = std::min(xmax, fc->clipMax.x);
+        ymin = std::max(ymin, fc->clipMin.y);
+        ymax = std::min(ymax, fc->clipMax.y);
+    }
+
+    b.workers = new Worker[numbThreads];
+    b.numbWorkers = numbThreads;
+    b.numbPolys = numbRings;
+    b.v = v;
+    b.ringOffsets = ringOffsets;
+    b.polyWorker = b.polyWs = NULL;
+    b.wsOffsets = (int*) malloc((numbThreads + 1) * sizeof(int));
+    b.weOffsets = (int*) malloc((numbThreads + 1) * sizeof(int));
+    b.fc = fc;
+    if (!b.wsOffsets || !b.weOffsets) status = -1;
+
+    for (i = 0; i < numbThreads; i++) {
+        w = &b.workers[i];
+        initFillContext(&w->fc);
+        w->fc.cleanInput = fc->cleanInput;
+        w->fc.fillRule = fc->fillRule;
+        w->fc.clip = fc->clip;
+        w->fc.clipMin = fc->clipMin;
+        w->fc.clipMax = fc->clipMax;
+        w->fc.tolerance = fc->tolerance;
+        w->status = 0;
+        w->slabMin.x = std::min(std::max(sides[i], xmin), xmax);
+        w->slabMin.y = ymin;
+        w->slabMax.x = std::min(std::max(sides[i+1], xmin), xmax);
+        w->slabMax.y = ymax;
+    }
+    free(sides);
+
+    if (!status) {
+        runWorkers(&b, decomposeSlab);
+        for (i = 0; i < numbThreads; i++) status |= b.workers[i].status;
+    }
+
+    if (!status) {
+        b.wsOffsets[0] = b.weOffsets[0] = 0;
+        for (k = 0; k < numbThreads; k++) {
+            b.wsOffsets[k+1] = b.wsOffsets[k] + b.workers[k].fc.numbWs;
+            b.weOffsets[k+1] = b.weOffsets[k] + b.workers[k].fc.numbWe;
+        }
+        if (reserveWedges(fc, b.wsOffsets[numbThreads] + 1, b.weOffsets[numbThreads])) status = -1;
+    }
+
+    fc->numbWs = fc->numbWe = fc->numbSunk = 0;
+    if (!status) {
+        runWorkers(&b, copySlab);
+        fc->numbWs = b.wsOffsets[numbThreads];
+        fc->numbWe = b.weOffsets[numbThreads];
+        fc->ws[fc->numbWs].opcode = END;
+    }
+
+    for (i = 0; i < numbThreads; i++) freeFillContext(&b.workers[i].fc);
+    delete[] b.workers;
+    free(b.wsOffsets);
+    free(b.weOffsets);
+    return status? -1: fc->numbWs;
+}
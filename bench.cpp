@@ -0,0 +1,432 @@
+/*
+ * bench.cpp
+ *
+ * Time fillPoly() on a corpus of generated polygons of 10 to 10^6
+ * vertices, and report per polygon
+ *
+ *   seqs, wedges   wedge sequences and elements made (triangles and
+ *                  added points when triangulating)
+ *   ns/vertex      best of 5 runs; growing with the size means a
+ *                  worse than linear phase
+ *   allocs         buffer (re)allocations of the first call, then of all
+ *                  timed calls on the warm context (should be 0)
+ *   peak KB        memory held by the context, which only grows
+ *   node B/vertex  memory taken by its chain nodes
+ *
+ * then time filling them into a coverage mask, and show what each
+ * fc->tolerance saves on the polygons scaled down to 256 pixels, where
+ * many vertices fall within a pixel:
+ *
+ *   tolerance      in pixels, 0 for exact
+ *   seqs, wedges   as above, and the wedges saved over tolerance 0
+ *   area           the mask coverage, relative to tolerance 0
+ *
+ * Build once per node layout and compare:
+ *
+ *   g++ -O2 -o bench bench.cpp hain.cpp raster.cpp
+ *   g++ -O2 -DINDEX_NODES -o bench_index bench.cpp hain.cpp raster.cpp
+ *
+ * and likewise per coordinate type (-DDOUBLE_COORDS, -DFIXED_COORDS).
+ * Fixed-point polygons are scaled to 2^20 pixels.
+ *
+ * Built with -DFILL_STATS, it also shows the time of each phase of
+ * fillPoly() and what it counted, for each polygon of 10^5 vertices,
+ * and the vertices each tolerance snapped, flattened and aligned.
+ *
+ * Allocations are counted on glibc only. bench.js times hain() and
+ * sweep() of the JS versions on the same polygons.
+ */
+
+#include <string.h>
+#include <chrono>
+#include "hain.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef __GLIBC__
+/* All buffers of a FillContext are (re)allocated by realloc() */
+static long numbAllocs = 0;
+
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+extern "C" void *realloc(void *p, size_t size)
+{
+    numbAllocs++;
+    return __libc_realloc(p, size);
+}
+#define ALLOCS() numbAllocs
+#else
+#define ALLOCS() -1L
+#endif
+
+/* a generated vertex, made into a Point by toPoints() */
+typedef struct {
+    float x, y;
+} Vertex;
+
+/* pixels f as a coordinate */
+#ifdef FIXED_COORDS
+#define COORD(f) ((Coord)lrintf((f) * (1 << FIXED_SHIFT)))
+#else
+#define COORD(f) ((Coord)(f))
+#endif
+
+static unsigned seed = 1;
+
+static float frand(void)
+{
+/* Uniform in [0, 1), the same sequence on every platform */
+    seed = seed * 1103515245u + 12345u;
+    return (float)((seed >> 8) & 0xffffff) / 16777216.0f;
+}
+/*-------------------------------------------------------*/
+static int convex(Vertex v[], int n)
+{
+/* Points on a circle at increasing angles: one window, no split joins */
+    int i;
+    float a;
+
+    for (i = 0; i < n; i++) {
+        a = -2 * M_PI * (i + 0.5f * frand()) / n; /* clockwise */
+        v[i].x = 100 * cosf(a);
+        v[i].y = 100 * sinf(a);
+    }
+    return n;
+}
+/*-------------------------------------------------------*/
+static int star(Vertex v[], int n)
+{
+/* Points at increasing angles and random radii: many short chains */
+    int i;
+    float a, r;
+
+    for (i = 0; i < n; i++) {
+        a = -2 * M_PI * (i + 0.5f * frand()) / n; /* clockwise */
+        r = 30 + 70 * frand();
+        v[i].x = r * cosf(a);
+        v[i].y = r * sinf(a);
+    }
+    return n;
+}
+/*-------------------------------------------------------*/
+static int comb(Vertex v[], int n)
+{
+/* Teeth pointing up from a common base: long windows split many times */
+    int i, k = 0, teeth = (n - 1) / 4;
+
+    v[k].x = 0;
+    v[k++].y = 0;
+    for (i = 0; i < teeth; i++) {
+        v[k].x = 4*i + 0.3f * frand();
+        v[k++].y = 10 + 0.3f * frand();
+        v[k].x = 4*i + 2 + 0.3f * frand();
+        v[k++].y = 10 + 0.3f * frand();
+        v[k].x = 4*i + 2 + 0.3f * frand();
+        v[k++].y = 1 + 0.3f * frand();
+        v[k].x = 4*i + 4 + 0.3f * frand();
+        v[k++].y = 1 + 0.3f * frand();
+    }
+    v[k-1].y = 0;
+    return k;
+}
+/*-------------------------------------------------------*/
+static int spiral(Vertex v[], int n)
+{
+/* A band wound around the origin: few, very long chains */
+    int i, m = n / 2, per = 100;
+    float t;
+
+    for (i = 0; i < m; i++) {
+        t = -2 * M_PI * i / per;
+        v[i].x = (1.5f - t) * cosf(t);
+        v[i].y = (1.5f - t) * sinf(t);
+        v[n-1-i].x = (1 - t) * cosf(t);
+        v[n-1-i].y = (1 - t) * sinf(t);
+    }
+    return 2*m;
+}
+/*-------------------------------------------------------*/
+static int walk(Vertex v[], int n)
+{
+/* Radius doing a random walk around the origin, like a traced outline:
+ * chains of every length */
+    int i;
+    float a, r = 100, step = 400 / sqrtf((float)n);
+
+    for (i = 0; i < n; i++) {
+        a = -2 * M_PI * i / n; /* clockwise */
+        r += step * (frand() - 0.5f);
+        if (r < 10) r = 20 - r;
+        if (r > 190) r = 380 - r;
+        v[i].x = r * cosf(a);
+        v[i].y = r * sinf(a);
+    }
+    return n;
+}
+/*-------------------------------------------------------*/
+static void toPoints(Point p[], const Vertex v[], int n, float size)
+{
+/* p = v scaled to fit a size x size square at the origin, or unscaled if
+ * size is 0. Fixed-point coordinates are always scaled, to 2^20 pixels
+ * if size is 0, to stay within their range. */
+    float xmin = FLT_MAX, xmax = -FLT_MAX, ymin = FLT_MAX, ymax = -FLT_MAX;
+    int i;
+
+#ifdef FIXED_COORDS
+    if (size == 0) size = 1 << 20;
+#endif
+    if (size == 0) {
+        for (i = 0; i < n; i++) {
+            p[i].x = COORD(v[i].x);
+            p[i].y = COORD(v[i].y);
+        }
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        xmin = fminf(xmin, v[i].x);
+        xmax = fmaxf(xmax, v[i].x);
+        ymin = fminf(ymin, v[i].y);
+        ymax = fmaxf(ymax, v[i].y);
+    }
+    for (i = 0; i < n; i++) {
+        p[i].x = COORD((v[i].x - xmin) * size / (xmax - xmin));
+        p[i].y = COORD((v[i].y - ymin) * size / (ymax - ymin));
+    }
+}
+/*-------------------------------------------------------*/
+static const struct {
+    const char *name;
+    int (*make)(Vertex[], int);
+} corpus[] = {{"convex", convex}, {"star", star}, {"comb", comb}, {"spiral", spiral}, {"walk", walk}};
+
+#define NUMB_CORPUS ((int)(sizeof(corpus) / sizeof(corpus[0])))
+
+static size_t nodeBytes(const FillContext *fc)
+{
+/* Memory taken by the chain nodes of fc */
+#ifdef INDEX_NODES
+    return (size_t)fc->maxNodes * (3*sizeof(Coord) + sizeof(JoinType) + 4*sizeof(NodeRef));
+#else
+    return (size_t)(fc->maxNodes + fc->maxAdded) * sizeof(ChainNode);
+#endif
+}
+/*-------------------------------------------------------*/
+static size_t contextBytes(const FillContext *fc)
+{
+/* Memory held by all buffers of fc */
+    return nodeBytes(fc) +
+        (size_t)fc->maxWs * sizeof(WedgeSequence) + (size_t)fc->maxWe * sizeof(WedgeElement) +
+        (size_t)fc->maxTriangles * 3*sizeof(int) + (size_t)fc->maxAddedPoints * sizeof(Point) +
+        (size_t)(fc->maxAddedVertex + fc->maxBridgeVertex) * sizeof(int) +
+        (size_t)(fc->maxMonoStack + fc->maxRings + fc->maxJoins + fc->maxSplits) * sizeof(NodeRef) +
+        (size_t)fc->maxJoinKeys * sizeof(JoinKey) + (size_t)fc->maxSweep * sizeof(TreapNode*) +
+        (size_t)fc->maxTreap * sizeof(TreapNode) +
+        (size_t)(fc->maxRayHits + fc->maxAddedEdges) * sizeof(int);
+}
+/*-------------------------------------------------------*/
+static void run(const char *name, int (*make)(Vertex[], int), int n, int triangulate)
+{
+    FillContext fc;
+    Vertex *g = (Vertex*) malloc(n * sizeof(Vertex));
+    Point *v = (Point*) malloc(n * sizeof(Point));
+    int reps, trial, i, numbOut;
+    long coldAllocs, warmAllocs;
+    char allocs[32] = "-";
+    double ns, best = 1e30;
+
+    n = make(g, n);
+    toPoints(v, g, n, 0);
+    initFillContext(&fc);
+    fc.triangulate = triangulate;
+    coldAllocs = ALLOCS();
+    numbOut = fillPoly(&fc, n, v);
+    coldAllocs = ALLOCS() - coldAllocs;
+    warmAllocs = ALLOCS();
+    reps = 200000 / n + 1;
+    for (trial = 0; trial < 5; trial++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (i = 0; i < reps; i++) numbOut = fillPoly(&fc, n, v);
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        if (ns / reps / n < best) best = ns / reps / n;
+    }
+    warmAllocs = ALLOCS() - warmAllocs;
+    if (ALLOCS() >= 0) snprintf(allocs, sizeof(allocs), "%ld/%ld", coldAllocs, warmAllocs);
+    printf("%-8s %8d %8d %8d %10.1f %10s %9.1f %13.1f\n", name, n, numbOut,
+           triangulate? fc.numbAddedPoints: fc.numbWe, best, allocs,
+           contextBytes(&fc) / 1024.0, (double)nodeBytes(&fc) / n);
+    freeFillContext(&fc);
+    free(g);
+    free(v);
+}
+/*-------------------------------------------------------*/
+#ifdef FILL_STATS
+/* a row of the stats table: expr for each polygon k */
+#define STATS_ROW(label, fmt, expr) do { \
+        printf("%-18s", label); \
+        for (k = 0; k < NUMB_CORPUS; k++) printf(" " fmt, expr); \
+        printf("\n"); \
+    } while (0)
+
+static void runStats(int n)
+{
+/* Phase times and counts of a warm fillPoly() of each polygon of n vertices */
+    FillContext fc;
+    FillStats st[NUMB_CORPUS];
+    Vertex *g = (Vertex*) malloc(n * sizeof(Vertex));
+    Point *v = (Point*) malloc(n * sizeof(Point));
+    int k, m, ph;
+
+    initFillContext(&fc);
+    for (k = 0; k < NUMB_CORPUS; k++) {
+        m = corpus[k].make(g, n);
+        toPoints(v, g, m, 0);
+        fillPoly(&fc, m, v);
+        fillPoly(&fc, m, v);
+        st[k] = fc.stats;
+    }
+    printf("\nus for %-11d", n);
+    for (k = 0; k < NUMB_CORPUS; k++) printf(" %10s", corpus[k].name);
+    printf("\n");
+    for (ph = 0; ph < NUMB_PHASES; ph++)
+        STATS_ROW(phaseNames[ph], "%10.1f", st[k].seconds[ph] * 1e6);
+    STATS_ROW("joins", "%10ld", st[k].joins);
+    STATS_ROW("  PEAK", "%10ld", st[k].peaks);
+    STATS_ROW("  DCUSP", "%10ld", st[k].dcusps);
+    STATS_ROW("  UCUSP", "%10ld", st[k].ucusps);
+    STATS_ROW("  POSCROSSPROD", "%10ld", st[k].posCrossProds);
+    STATS_ROW("  split", "%10ld", st[k].splits);
+    STATS_ROW("ADDED_NODEs", "%10ld", st[k].addedNodes);
+    STATS_ROW("window steps", "%10ld", st[k].windowSteps);
+    STATS_ROW("sequences", "%10ld", st[k].pieces);
+    STATS_ROW("  monotone loops", "%10ld", st[k].monotone);
+    STATS_ROW("wedges/sequence", "%10.1f", st[k].pieces? (double)st[k].wedges / st[k].pieces: 0.0);
+    STATS_ROW("max wedges", "%10ld", st[k].maxWedges);
+    freeFillContext(&fc);
+    free(g);
+    free(v);
+}
+/*-------------------------------------------------------*/
+#endif
+static void runMask(const char *name, int (*make)(Vertex[], int), int n, int size, int samples)
+{
+/* Decompose and fill a polygon scaled to a size x size mask */
+    FillContext fc;
+    Mask m;
+    Vertex *g = (Vertex*) malloc(n * sizeof(Vertex));
+    Point *v = (Point*) malloc(n * sizeof(Point));
+    int reps = 20, trial, i;
+    double ns, best = 1e30, covered = 0;
+
+    n = make(g, n);
+    toPoints(v, g, n, (float)size);
+    m.mask = (unsigned char*) malloc((size_t)size * size);
+    m.width = m.height = m.stride = size;
+    m.samples = samples;
+    initFillContext(&fc);
+    fc.sink = maskSink;
+    fc.sinkData = &m;
+    for (trial = 0; trial < 5; trial++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (i = 0; i < reps; i++) {
+            memset(m.mask, 0, (size_t)size * size);
+            fillPoly(&fc, n, v);
+        }
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        if (ns / reps < best) best = ns / reps;
+    }
+    for (i = 0; i < size * size; i++) covered += m.mask[i] / 255.0;
+    printf("%-8s %8d %6d %8d %10.1f %10.1f\n", name, n, size, samples, best / 1000, best / covered);
+    freeFillContext(&fc);
+    free(m.mask);
+    free(g);
+    free(v);
+}
+/*-------------------------------------------------------*/
+static void runTolerance(const char *name, int (*make)(Vertex[], int), int n, int size)
+{
+/* Decompose a polygon scaled to a size x size mask at each tolerance */
+    static const double tolerances[] = {0, .125, .25, .5, 1, 2};
+    FillContext fc;
+    Mask m;
+    Vertex *g = (Vertex*) malloc(n * sizeof(Vertex));
+    Point *v = (Point*) malloc(n * sizeof(Point));
+    int i, t, numbOut;
+    double covered, exactCovered = 0;
+    long exactWedges = 0;
+
+    n = make(g, n);
+    toPoints(v, g, n, (float)size);
+    m.mask = (unsigned char*) malloc((size_t)size * size);
+    m.width = m.height = m.stride = size;
+    m.samples = 4;
+    initFillContext(&fc);
+    for (t = 0; t < (int)(sizeof(tolerances) / sizeof(tolerances[0])); t++) {
+        fc.tolerance = tolerances[t];
+        fc.sink = NULL;
+        numbOut = fillPoly(&fc, n, v);
+        if (t == 0) exactWedges = fc.numbWe;
+        printf("%-8s %8d %9.3f %8d %8d %7.1f%%", name, n, fc.tolerance, numbOut, fc.numbWe,
+               exactWedges? 100.0 * (exactWedges - fc.numbWe) / exactWedges: 0.0);
+#ifdef FILL_STATS
+        printf(" %8ld %9ld %8ld", fc.stats.snapped, fc.stats.flattened, fc.stats.aligned);
+#endif
+        fc.sink = maskSink;
+        fc.sinkData = &m;
+        memset(m.mask, 0, (size_t)size * size);
+        fillPoly(&fc, n, v);
+        for (i = 0, covered = 0; i < size * size; i++) covered += m.mask[i] / 255.0;
+        if (t == 0) exactCovered = covered;
+        printf(" %9.4f\n", exactCovered? covered / exactCovered: 0.0);
+    }
+    freeFillContext(&fc);
+    free(m.mask);
+    free(g);
+    free(v);
+}
+/*-------------------------------------------------------*/
+int main(void)
+{
+    int i, k, n, triangulate;
+
+#ifdef INDEX_NODES
+    printf("node layout: arrays with 32-bit index links\n");
+#else
+    printf("node layout: ChainNode structs with pointer links (%d bytes)\n", (int)sizeof(ChainNode));
+#endif
+#if defined(FIXED_COORDS)
+    printf("coordinates: 32-bit fixed point, %d fraction bits\n", FIXED_SHIFT);
+#elif defined(DOUBLE_COORDS)
+    printf("coordinates: double\n");
+#else
+    printf("coordinates: float\n");
+#endif
+    for (triangulate = 0; triangulate <= 1; triangulate++) {
+        printf("\n%-8s %8s %8s %8s %10s %10s %9s %13s\n", "polygon", "vertices",
+               triangulate? "tris": "seqs", triangulate? "added": "wedges",
+               "ns/vertex", "allocs", "peak KB", "node B/vertex");
+        for (k = 0; k < NUMB_CORPUS; k++)
+            for (n = 10; n <= 1000000; n *= 10)
+                run(corpus[k].name, corpus[k].make, n, triangulate);
+    }
+
+#ifdef FILL_STATS
+    runStats(100000);
+#endif
+
+    printf("\n%-8s %8s %6s %8s %10s %10s\n", "polygon", "vertices", "size", "samples", "us/fill", "ns/pixel");
+    for (i = 1; i <= 16; i *= 4) {
+        runMask("star", star, 1000, 1024, i);
+        runMask("comb", comb, 1000, 1024, i);
+        runMask("spiral", spiral, 1000, 1024, i);
+    }
+
+    printf("\n%-8s %8s %9s %8s %8s %8s", "polygon", "vertices", "tolerance", "seqs", "wedges", "saved");
+#ifdef FILL_STATS
+    printf(" %8s %9s %8s", "snapped", "flattened", "aligned");
+#endif
+    printf(" %9s\n", "area");
+    for (k = 0; k < NUMB_CORPUS; k++) runTolerance(corpus[k].name, corpus[k].make, 10000, 256);
+    return 0;
+}
@@ -0,0 +1,107 @@
+
+// Times hain() and sweep() on the polygons of bench.cpp (same generators,
+// same random sequence), in ns per vertex, to compare with its output;
+// and hain() of the addon (addon.cpp) too where it is built.
+
+var Benchmark = require('benchmark');
+
+var addon = require('./hain'),
+    hain = addon.js || addon; // the JS version even where the addon is built
+var sweep = require('./sweep');
+
+global.drawPoly = function () {}; // both draw their diagonals when run in the browser
+
+var seed = 1;
+
+function frand() {
+    seed = (Math.imul(seed, 1103515245) + 12345) >>> 0;
+    return ((seed >>> 8) & 0xffffff) / 16777216;
+}
+
+function convex(n) {
+    var points = [];
+    for (var i = 0; i < n; i++) {
+        var a = -2 * Math.PI * (i + 0.5 * frand()) / n;
+        points.push([Math.fround(100 * Math.cos(a)), Math.fround(100 * Math.sin(a))]);
+    }
+    return points;
+}
+
+function star(n) {
+    var points = [];
+    for (var i = 0; i < n; i++) {
+        var a = -2 * Math.PI * (i + 0.5 * frand()) / n,
+            r = 30 + 70 * frand();
+        points.push([Math.fround(r * Math.cos(a)), Math.fround(r * Math.sin(a))]);
+    }
+    return points;
+}
+
+function comb(n) {
+    var points = [[0, 0]],
+        teeth = Math.floor((n - 1) / 4);
+    for (var i = 0; i < teeth; i++) {
+        points.push([4 * i + 0.3 * frand(), 10 + 0.3 * frand()]);
+        points.push([4 * i + 2 + 0.3 * frand(), 10 + 0.3 * frand()]);
+        points.push([4 * i + 2 + 0.3 * frand(), 1 + 0.3 * frand()]);
+        points.push([4 * i + 4 + 0.3 * frand(), 1 + 0.3 * frand()]);
+    }
+    points[points.length - 1][1] = 0;
+    return points.map(function (p) { return [Math.fround(p[0]), Math.fround(p[1])]; });
+}
+
+function spiral(n) {
+    var m = Math.floor(n / 2),
+        points = new Array(2 * m);
+    for (var i = 0; i < m; i++) {
+        var t = -2 * Math.PI * i / 100;
+        points[i] = [Math.fround((1.5 - t) * Math.cos(t)), Math.fround((1.5 - t) * Math.sin(t))];
+        points[2 * m - 1 - i] = [Math.fround((1 - t) * Math.cos(t)), Math.fround((1 - t) * Math.sin(t))];
+    }
+    return points;
+}
+
+function walk(n) {
+    var points = [],
+        r = 100,
+        step = 400 / Math.sqrt(n);
+    for (var i = 0; i < n; i++) {
+        var a = -2 * Math.PI * i / n;
+        r = Math.fround(r + step * (frand() - 0.5));
+        if (r < 10) r = 20 - r;
+        if (r > 190) r = 380 - r;
+        points.push([Math.fround(r * Math.cos(a)), Math.fround(r * Math.sin(a))]);
+    }
+    return points;
+}
+
+var suite = new Benchmark.Suite(),
+    vertices = {};
+
+[['convex', convex], ['star', star], ['comb', comb], ['spiral', spiral], ['walk', walk]].forEach(function (gen) {
+    [1000, 10000].forEach(function (n) {
+        var points = gen[1](n),
+            reversed = points.slice().reverse(); // sweep() takes the other orientation
+        vertices['hain ' + gen[0] + ' ' + n] = vertices['sweep ' + gen[0] + ' ' + n] =
+            vertices['addon ' + gen[0] + ' ' + n] = points.length;
+        suite.add('hain ' + gen[0] + ' ' + n, function () {
+            hain(points);
+        });
+        if (addon !== hain) suite.add('addon ' + gen[0] + ' ' + n, function () {
+            addon(points);
+        });
+        suite.add('sweep ' + gen[0] + ' ' + n, function () {
+            sweep(reversed);
+        });
+    });
+});
+
+suite
+    .on('error', function(event) {
+        console.log(event.target.error);
+    })
+    .on('cycle', function(event) {
+        console.log(String(event.target) + ', ' +
+            (1e9 / event.target.hz / vertices[event.target.name]).toFixed(1) + ' ns/vertex');
+    })
+    .run();
@@ -0,0 +1,9 @@
+{
+  "targets": [
+    {
+      "target_name": "hain",
+      "sources": ["addon.cpp", "hain.cpp"],
+      "cflags_cc": ["-O2"]
+    }
+  ]
+}
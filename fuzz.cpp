@@ -0,0 +1,1087 @@
+/*
+ * fuzz.cpp
+ *
+ * Decompose random simple polygons by fillPoly() in each of its modes
+ *
+ *   wedges     wedge sequences
+ *   triangles  triangles, with fc->triangulate
+ *   clean      wedge sequences, with fc->cleanInput
+ *   non-zero   wedge sequences, by the NON_ZERO fill rule
+ *   clip       wedge sequences, clipped to the middle of the polygon
+ *   strips     fillStrips() of the polygon with a vertex moved to the
+ *              middle of its neighbours, then moveVertices() putting it
+ *              back, which must keep the output of the other strips
+ *
+ * and, by fillRings() and the others, rings made from it
+ *
+ *   holes      the polygon scaled up, with up to MAX_HOLES small holes
+ *              (triangles for an even number of rings)
+ *   even-odd   the polygon with a ring laid over it whose edges cross,
+ *              by the EVEN_ODD fill rule
+ *   overlap    the same, by the NON_ZERO fill rule
+ *   polys      fillPolys() of the polygon and up to MAX_POLYS-1 others,
+ *              which must make of each what fillPoly() does
+ *   slabs      fillSlabs() of a star of MIN_STAR to MAX_STAR vertices,
+ *              with holes
+ *   tolerance  holes, with fc->tolerance
+ *   store      storeWedges() of the wedge sequences (with 16-bit slopes
+ *              for an odd number of vertices), read back as fillStore()
+ *              reads them, which checkStore() must take
+ *   large      a star of LARGE_VERTICES or more vertices, with a tolerance
+ *              of a pixel for an odd number, every LARGE_EVERY cases; it
+ *              must take no more than LARGE_TIME seconds
+ *
+ * and check what it makes: no wedge may have a negative height or its
+ * left side right of its right side, and no triangle may be
+ * counterclockwise; they must have the area of the polygon (or of its
+ * part inside the clip rectangle) in all, and cover each of a grid of
+ * points over it once if it is inside, else not at all. Where rings
+ * cross, only the points are checked, by how often the rings wind around
+ * them, and with fixed-point coordinates a wedge may be inside out by any
+ * amount where it ends at a crossing, as that was rounded to a Coord
+ * (nearly parallel edges cross far from where they are a Coord apart).
+ * With a tolerance, the area may be off by the tolerance times the
+ * perimeter, a wedge inside out by twice the tolerance (where a part is
+ * narrower than that), and points that close to an edge are not checked.
+ *
+ * A polygon that fails is shrunk to the fewest vertices that still fail
+ * in that mode, and printed (slabs and large are too big, and are named
+ * by seed only: "./fuzz 1 seed" runs the case again). fuzz.js makes the
+ * same polygons (same generator, same seeds) for hain() and sweep() of
+ * the JS versions; what the other modes add to them is drawn from a
+ * seed of their own.
+ *
+ *   g++ -O2 -o fuzz fuzz.cpp hain.cpp batch.cpp store.cpp raster.cpp -lpthread
+ *   ./fuzz [cases [seed]]
+ *
+ * and likewise per node layout and coordinate type (-DINDEX_NODES,
+ * -DDOUBLE_COORDS, -DFIXED_COORDS). Exits with 1 if a polygon failed.
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include "hain.h"
+
+#define MAX_VERTICES 40 /* of the polygons made */
+#define MAX_CLIPPED (16*MAX_VERTICES) /* of one clipped to the four sides of a rectangle */
+#define SAMPLES 32 /* points checked along each side of a polygon */
+#define TIME_LIMIT 5 /* seconds a decomposition may take before it is taken to hang */
+#define MAX_STRIPS 4 /* of fillStrips() */
+#define MAX_HOLES 4 /* tried in each polygon */
+#define HOLE_SCALE 16 /* a polygon with holes is scaled up by, to make room for them */
+#define MAX_CROSSING 12 /* vertices of the ring laid over a polygon */
+#define MAX_POLYS 6 /* of fillPolys() */
+#define MAX_THREADS 4 /* of fillPolys() and fillSlabs() */
+#define MIN_STAR 128 /* vertices of the polygons of fillSlabs(), the fewest it cuts in two */
+#define MAX_STAR 256
+#define LARGE_VERTICES (1 << 17) /* of the large polygon, at least */
+#define LARGE_GRID (1 << 22) /* it is on */
+#define LARGE_EVERY 1000 /* cases */
+#define LARGE_TIME 2.0 /* seconds its decomposition may take */
+#define LARGE_SAMPLES 8 /* as SAMPLES, for it, as each takes a pass over all its edges */
+#define MAX_RINGS (MAX_POLYS + MAX_HOLES) /* of a case */
+#define MAX_POINTS (2 * LARGE_VERTICES) /* vertices of a case */
+#define MAX_SHRUNK (MAX_POLYS * MAX_VERTICES) /* vertices of a case that is shrunk */
+
+/* grid coordinate c as a Coord, and how far fillPoly() may move a point
+ * it adds by rounding it to a Coord */
+#ifdef FIXED_COORDS
+#define COORD(c) ((Coord)((c) << FIXED_SHIFT))
+#define ROUNDING 1.0
+#else
+#define COORD(c) ((Coord)(c))
+#define ROUNDING 0.0
+#endif
+#define PIXEL ((double)COORD(1)) /* in coordinates */
+
+/* How a polygon is decomposed */
+typedef enum {
+    WEDGES,
+    TRIANGLES,
+    CLEANED,
+    FILLED,
+    CLIPPED,
+    STRIPS,
+    HOLES,
+    EVEN_ODD_RINGS,
+    NON_ZERO_RINGS,
+    POLYS,
+    SLABS,
+    SIMPLIFIED,
+    STORED,
+    LARGE,
+    NUMB_MODES
+} Mode;
+
+static const char *modeNames[NUMB_MODES] = {"wedges", "triangles", "clean", "non-zero", "clip", "strips",
+                                            "holes", "even-odd", "overlap", "polys", "slabs", "tolerance",
+                                            "store", "large"};
+
+static const double tolerances[4] = {.25, .5, 1, 4}; /* in pixels, by number of vertices */
+
+/* a generated vertex, on a grid */
+typedef struct {
+    int x, y;
+} Vertex;
+
+/* a wedge element or triangle, as a clockwise quadrangle (a triangle
+ * repeats its last corner), in coordinates */
+typedef struct {
+    double x[4], y[4];
+} Quad;
+
+static unsigned seed = 1;
+static unsigned moreSeed = 1; /* of what the modes add to a polygon */
+
+static Quad *quads; /* of the polygon checked */
+static int maxQuads;
+
+static WedgeSequence *keptWs; /* output of fillStrips() before moveVertices() */
+static WedgeElement *keptWe;
+static int keptStripWs[MAX_STRIPS + 1], maxKeptWs, maxKeptWe;
+
+static FillContext alone; /* fillPoly() of each polygon of fillPolys() */
+static char *store; /* of storeWedges() */
+static size_t maxStore;
+
+static char problem[256]; /* what check() found wrong */
+static volatile unsigned caseSeed; /* of the polygon checked */
+static volatile int caseMode;
+static const char *volatile caseCall; /* what decomposes it */
+
+static int irand(int k)
+{
+/* Uniform in [0, k), the same sequence as irand() of fuzz.js */
+    seed = seed * 1103515245u + 12345u;
+    return (int)((seed >> 8) % (unsigned)k);
+}
+/*-------------------------------------------------------*/
+static int xrand(int k)
+{
+/* Uniform in [0, k), as irand() but from moreSeed, so that the polygons
+ * stay the ones of fuzz.js */
+    moreSeed = moreSeed * 1103515245u + 12345u;
+    return (int)((moreSeed >> 8) % (unsigned)k);
+}
+/*-------------------------------------------------------*/
+static long long cross(Vertex a, Vertex b, Vertex c)
+{
+    return (long long)(b.x - a.x) * (c.y - a.y) - (long long)(b.y - a.y) * (c.x - a.x);
+}
+/*-------------------------------------------------------*/
+static int onSegment(Vertex p, Vertex a, Vertex b)
+{
+    return cross(a, b, p) == 0 &&
+        ((a.x <= p.x && p.x <= b.x) || (b.x <= p.x && p.x <= a.x)) &&
+        ((a.y <= p.y && p.y <= b.y) || (b.y <= p.y && p.y <= a.y));
+}
+/*-------------------------------------------------------*/
+static int intersect(Vertex a, Vertex b, Vertex c, Vertex d)
+{
+/* Whether the segments ab and cd have a point in common */
+    long long d1 = cross(c, d, a), d2 = cross(c, d, b),
+              d3 = cross(a, b, c), d4 = cross(a, b, d);
+
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) return 1;
+    return onSegment(a, c, d) || onSegment(b, c, d) || onSegment(c, a, b) || onSegment(d, a, b);
+}
+/*-------------------------------------------------------*/
+static int findCrossing(const Vertex v[], int n, int c[2])
+{
+/* Whether two edges meet other than at the vertex between them, with
+ * the first such edges in c */
+    Vertex a, b, p, q;
+    int i, j, meet;
+
+    for (i = 0; i < n; i++)
+        for (j = i + 1; j < n; j++) {
+            a = v[i];
+            b = v[(i + 1) % n];
+            p = v[j];
+            q = v[(j + 1) % n];
+            if (j == i + 1) meet = onSegment(a, p, q) || onSegment(q, a, b); /* b == p */
+            else if (i == 0 && j == n - 1) meet = onSegment(b, p, q) || onSegment(p, a, b); /* a == q */
+            else meet = intersect(a, b, p, q);
+            if (meet) {
+                c[0] = i;
+                c[1] = j;
+                return 1;
+            }
+        }
+    return 0;
+}
+/*-------------------------------------------------------*/
+static long long twiceArea(const Vertex v[], int n)
+{
+/* Positive if counterclockwise */
+    long long s = 0;
+    int i, j;
+
+    for (i = 0, j = n - 1; i < n; j = i++)
+        s += (long long)(v[j].x - v[i].x) * (v[j].y + v[i].y);
+    return s;
+}
+/*-------------------------------------------------------*/
+static int randomPolygon(Vertex v[], int (*draw)(int))
+{
+/*----------------------------------------------
+ * Make a simple clockwise polygon of 3 to MAX_VERTICES vertices on a grid
+ * of 8, 64 or 65536, untangled from random points by reversing the part
+ * between two edges that cross (2-opt). The small grids make many
+ * horizontal edges, collinear vertices and vertices on the same x.
+ * The numbers are drawn by draw (irand or xrand).
+ * Returns the number of vertices.
+ */
+    static const int grids[3] = {8, 64, 65536};
+    Vertex t;
+    int grid, n, m, i, k, found, c[2];
+
+    for (;;) {
+        grid = grids[draw(3)];
+        n = 3 + draw((grid == 8)? 14: MAX_VERTICES - 2);
+        for (m = 0; m < n; ) {
+            v[m].x = draw(grid);
+            v[m].y = draw(grid);
+            for (i = 0; i < m && (v[i].x != v[m].x || v[i].y != v[m].y); i++) ;
+            if (i == m) m++; /* else a repeat, drawn again */
+        }
+        for (k = 0, found = 0; k < 8*n*n && (found = findCrossing(v, n, c)); k++) {
+            if (c[1] == c[0] + 1 || c[1] == c[0] + n - 1) break; /* edges along each other */
+            for (i = c[0] + 1, m = c[1]; i < m; i++, m--) {
+                t = v[i];
+                v[i] = v[m];
+                v[m] = t;
+            }
+        }
+        if (found || twiceArea(v, n) == 0) continue;
+        if (twiceArea(v, n) > 0)
+            for (i = 0, m = n - 1; i < m; i++, m--) {
+                t = v[i];
+                v[i] = v[m];
+                v[m] = t;
+            }
+        return n;
+    }
+}
+/*-------------------------------------------------------*/
+static int crossingRing(Vertex v[], const Vertex p[], int n)
+{
+/* Make a ring of 3 to MAX_CROSSING different vertices at random in the
+ * bounding box of the polygon p[0 .. n-1], with its edges crossing as
+ * they come. Returns the number of vertices. */
+    Vertex lo = p[0], hi = p[0];
+    int i, m, k;
+
+    for (i = 1; i < n; i++) {
+        lo.x = (p[i].x < lo.x)? p[i].x: lo.x;
+        lo.y = (p[i].y < lo.y)? p[i].y: lo.y;
+        hi.x = (p[i].x > hi.x)? p[i].x: hi.x;
+        hi.y = (p[i].y > hi.y)? p[i].y: hi.y;
+    }
+    n = 3 + xrand(MAX_CROSSING - 2);
+    if ((long long)(hi.x - lo.x + 1) * (hi.y - lo.y + 1) < n) n = (hi.x - lo.x + 1) * (hi.y - lo.y + 1);
+    for (m = 0; m < n; ) {
+        v[m].x = lo.x + xrand(hi.x - lo.x + 1);
+        v[m].y = lo.y + xrand(hi.y - lo.y + 1);
+        for (k = 0; k < m && (v[k].x != v[m].x || v[k].y != v[m].y); k++) ;
+        if (k == m) m++;
+    }
+    return n;
+}
+/*-------------------------------------------------------*/
+static int randomStar(Vertex v[], int n, int grid)
+{
+/* Make a clockwise polygon of n vertices on an even grid, going around
+ * its middle at random distances, each in its own n-th of the turn.
+ * Returns whether it is simple, which it is unless the grid is too
+ * coarse for n to keep each vertex clockwise of the one before. */
+    Vertex c;
+    double a, r;
+    int i, simple = 1;
+
+    c.x = c.y = grid / 2;
+    for (i = 0; i < n; i++) {
+        a = -2 * M_PI * (i + .25 + xrand(1024) / 2048.0) / n;
+        r = c.x * (.4 + .6 * xrand(1024) / 1024.0);
+        v[i].x = (int)floor(c.x + r * cos(a) + .5);
+        v[i].y = (int)floor(c.y + r * sin(a) + .5);
+    }
+    for (i = 0; i < n; i++) simple &= cross(c, v[i], v[(i + 1) % n]) < 0;
+    return simple;
+}
+/*-------------------------------------------------------*/
+static int insideRing(Vertex p, const Vertex v[], int n)
+{
+/* Whether p, which is on no edge, is inside the ring v[0 .. n-1] */
+    int i, j, in = 0;
+
+    for (i = 0, j = n - 1; i < n; j = i++)
+        if ((v[i].y > p.y) != (v[j].y > p.y) && (cross(v[j], v[i], p) > 0) == (v[i].y > v[j].y))
+            in = !in;
+    return in;
+}
+/*-------------------------------------------------------*/
+static int ringsMeet(const Vertex a[], int m, const Vertex b[], int n)
+{
+/* Whether an edge of the ring a[0 .. m-1] and one of b[0 .. n-1] have a
+ * point in common */
+    int i, j;
+
+    for (i = 0; i < m; i++)
+        for (j = 0; j < n; j++)
+            if (intersect(a[i], a[(i + 1) % m], b[j], b[(j + 1) % n])) return 1;
+    return 0;
+}
+/*-------------------------------------------------------*/
+static int holeFits(const Vertex v[], const int ringOffsets[], int k)
+{
+/* Whether ring k is inside ring 0 and out of rings 1 .. k-1, touching
+ * none of them */
+    const Vertex *h = v + ringOffsets[k], *r;
+    int j, m = ringOffsets[k+1] - ringOffsets[k], n;
+
+    if (!insideRing(h[0], v, ringOffsets[1])) return 0;
+    for (j = 0; j < k; j++) {
+        r = v + ringOffsets[j];
+        n = ringOffsets[j+1] - ringOffsets[j];
+        if (ringsMeet(h, m, r, n) || (j > 0 && (insideRing(h[0], r, n) || insideRing(r[0], h, m))))
+            return 0;
+    }
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int fitsMode(Mode mode, const Vertex v[], const int ringOffsets[], int numbRings)
+{
+/*----------------------------------------------
+ * Whether the rings (ring k at v[ringOffsets[k] .. ringOffsets[k+1]-1])
+ * are input that mode takes: for the even-odd and overlap modes, any
+ * rings of three or more vertices; for polys, simple clockwise polygons;
+ * else a simple clockwise polygon and counterclockwise holes in it, out
+ * of each other, no two rings touching.
+ */
+    const Vertex *r;
+    int k, n, c[2];
+
+    for (k = 0; k < numbRings; k++)
+        if (ringOffsets[k+1] - ringOffsets[k] < 3) return 0;
+    if (mode == EVEN_ODD_RINGS || mode == NON_ZERO_RINGS) return 1;
+    for (k = 0; k < numbRings; k++) {
+        r = v + ringOffsets[k];
+        n = ringOffsets[k+1] - ringOffsets[k];
+        if (findCrossing(r, n, c) || (twiceArea(r, n) < 0) != (k == 0 || mode == POLYS) ||
+            (mode != POLYS && k > 0 && !holeFits(v, ringOffsets, k)))
+            return 0;
+    }
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int addHoles(Vertex v[], int ringOffsets[], int numbRings)
+{
+/*----------------------------------------------
+ * Try MAX_HOLES counterclockwise holes in the polygon v[0 ..
+ * ringOffsets[1]-1]: squares, diamonds and triangles at random in its
+ * bounding box, up to an eighth of its size across, each kept if it
+ * fits (see holeFits). Returns the number of rings.
+ */
+    static const int shapes[3][4][2] = {{{-1, -1}, {1, -1}, {1, 1}, {-1, 1}},
+                                        {{0, -1}, {1, 0}, {0, 1}, {-1, 0}},
+                                        {{-1, -1}, {1, -1}, {0, 1}, {0, 1}}};
+    Vertex lo = v[0], hi = v[0], *h;
+    int i, k, s, r, x, y, n = ringOffsets[numbRings];
+
+    for (i = 1; i < ringOffsets[1]; i++) {
+        lo.x = (v[i].x < lo.x)? v[i].x: lo.x;
+        lo.y = (v[i].y < lo.y)? v[i].y: lo.y;
+        hi.x = (v[i].x > hi.x)? v[i].x: hi.x;
+        hi.y = (v[i].y > hi.y)? v[i].y: hi.y;
+    }
+    for (k = 0; k < MAX_HOLES; k++) {
+        s = xrand(3);
+        r = 1 + xrand(1 + ((hi.x - lo.x < hi.y - lo.y)? hi.x - lo.x: hi.y - lo.y) / 16);
+        x = lo.x + xrand(hi.x - lo.x + 1);
+        y = lo.y + xrand(hi.y - lo.y + 1);
+        h = v + n;
+        for (i = 0; i < 4 - (s == 2); i++) {
+            h[i].x = x + r * shapes[s][i][0];
+            h[i].y = y + r * shapes[s][i][1];
+        }
+        ringOffsets[numbRings + 1] = n + i;
+        if (holeFits(v, ringOffsets, numbRings)) n = ringOffsets[++numbRings];
+    }
+    return numbRings;
+}
+/*-------------------------------------------------------*/
+static int inside(double x, double y, const double px[], const double py[], int n)
+{
+/* Whether (x, y) is inside the polygon (px, py), by crossings */
+    int i, j, in = 0;
+
+    for (i = 0, j = n - 1; i < n; j = i++)
+        if ((py[i] > y) != (py[j] > y) &&
+            x < px[i] + (y - py[i]) * (px[j] - px[i]) / (py[j] - py[i]))
+            in = !in;
+    return in;
+}
+/*-------------------------------------------------------*/
+static int winding(double x, double y, const double px[], const double py[], const int ringOffsets[],
+                   int numbRings)
+{
+/* How often the rings (px, py) wind around (x, y), clockwise */
+    int i, j, k, w = 0;
+
+    for (k = 0; k < numbRings; k++)
+        for (i = ringOffsets[k], j = ringOffsets[k+1] - 1; i < ringOffsets[k+1]; j = i++)
+            if ((py[i] > y) != (py[j] > y) &&
+                x < px[i] + (y - py[i]) * (px[j] - px[i]) / (py[j] - py[i]))
+                w += (py[i] > py[j])? -1: 1;
+    return w;
+}
+/*-------------------------------------------------------*/
+static int nearEdge(double x, double y, const double px[], const double py[], int n, double eps)
+{
+/* Whether (x, y) is within eps of an edge of the polygon (px, py) */
+    double dx, dy, t;
+    int i, j;
+
+    for (i = 0, j = n - 1; i < n; j = i++) {
+        dx = px[i] - px[j];
+        dy = py[i] - py[j];
+        t = (dx == 0 && dy == 0)? 0: ((x - px[j]) * dx + (y - py[j]) * dy) / (dx * dx + dy * dy);
+        t = (t < 0)? 0: (t > 1)? 1: t;
+        if (fabs(px[j] + t * dx - x) + fabs(py[j] + t * dy - y) < eps) return 1;
+    }
+    return 0;
+}
+/*-------------------------------------------------------*/
+static double area(const double px[], const double py[], int n)
+{
+/* Positive if counterclockwise */
+    double s = 0;
+    int i, j;
+
+    for (i = 0, j = n - 1; i < n; j = i++) s += (px[j] - px[i]) * (py[j] + py[i]);
+    return s / 2;
+}
+/*-------------------------------------------------------*/
+static int clipSide(double px[], double py[], int n, int axis, double at, int keepBelow)
+{
+/* Clip the polygon (px, py) in place to the side of the line x = at (or
+ * y = at if axis is 1) that is below it if keepBelow, else above it
+ * (Sutherland-Hodgman). Returns the new number of vertices, at most
+ * twice n. */
+    double qx[MAX_CLIPPED], qy[MAX_CLIPPED], a, b, t;
+    int i, j, m = 0, ina, inb;
+
+    for (i = 0, j = n - 1; i < n; j = i++) {
+        a = axis? py[j]: px[j];
+        b = axis? py[i]: px[i];
+        ina = keepBelow? a <= at: a >= at;
+        inb = keepBelow? b <= at: b >= at;
+        if (ina != inb) {
+            t = (at - a) / (b - a);
+            qx[m] = px[j] + t * (px[i] - px[j]);
+            qy[m++] = py[j] + t * (py[i] - py[j]);
+        }
+        if (inb) {
+            qx[m] = px[i];
+            qy[m++] = py[i];
+        }
+    }
+    memcpy(px, qx, m * sizeof(double));
+    memcpy(py, qy, m * sizeof(double));
+    return m;
+}
+/*-------------------------------------------------------*/
+static Quad *addQuad(int numbQuads)
+{
+/* Room for quads[numbQuads], or NULL with problem set if out of memory */
+    Quad *q;
+
+    if (numbQuads >= maxQuads) {
+        q = (Quad*) realloc(quads, 2 * (numbQuads + 64) * sizeof(Quad));
+        if (!q) {
+            snprintf(problem, sizeof(problem), "out of memory");
+            return NULL;
+        }
+        quads = q;
+        maxQuads = 2 * (numbQuads + 64);
+    }
+    return &quads[numbQuads];
+}
+/*-------------------------------------------------------*/
+static int addWedge(int numbQuads, double xl, double xr, double lSlope, double rSlope, double yt, double h,
+                    double eps, int i, int k)
+{
+/* Add wedge element i of sequence k, from xl to xr at yt down h, as
+ * quads[numbQuads]; one inside out at an end by no more than eps is cut
+ * to the triangle that is not. Returns the number of quads, or -1 with
+ * problem set if it is wrong. */
+    Quad *q;
+    double wt, wb, t;
+    int j;
+
+    if (!(q = addQuad(numbQuads++))) return -1;
+    q->x[0] = xl;
+    q->x[1] = xr;
+    q->y[0] = q->y[1] = yt;
+    q->x[2] = xr - rSlope * h;
+    q->x[3] = xl - lSlope * h;
+    q->y[2] = q->y[3] = yt - h;
+    if (h < 0) {
+        snprintf(problem, sizeof(problem), "wedge %d of sequence %d of negative height", i, k);
+        return -1;
+    }
+    wt = q->x[1] - q->x[0]; /* widths at the top and bottom */
+    wb = q->x[2] - q->x[3];
+    if (wt >= 0 && wb >= 0) return numbQuads;
+    if (wt < -eps || wb < -eps) {
+        snprintf(problem, sizeof(problem), "wedge %d of sequence %d inside out", i, k);
+        return -1;
+    }
+    if (wt < 0 && wb < 0) return numbQuads;
+    t = wt / (wt - wb); /* where the sides cross, down from the top */
+    j = (wt < 0)? 0: 2;
+    q->x[j] = q->x[j+1] = q->x[0] + t * (q->x[3] - q->x[0]);
+    q->y[j] = q->y[j+1] = yt - t * h;
+    return numbQuads;
+}
+/*-------------------------------------------------------*/
+static int collectQuads(const FillContext *fc, const Point v[], int n, double eps)
+{
+/* The wedge elements or triangles of fc as quads, which may be inside
+ * out by eps. Returns their number, or -1 with problem set if one is
+ * wrong. */
+    const WedgeSequence *s;
+    const WedgeElement *e;
+    Quad *q;
+    Point p[3];
+    double xl, xr, lSlope, rSlope, yt, h;
+    int i, j, k, numbQuads = 0, type;
+
+    if (fc->triangulate) {
+        for (k = 0; k < fc->numbTriangles; k++) {
+            for (j = 0; j < 3; j++) {
+                i = fc->triangles[3*k + j];
+                if (i < 0 || i >= n + fc->numbAddedPoints) {
+                    snprintf(problem, sizeof(problem), "triangle %d has no vertex %d", k, i);
+                    return -1;
+                }
+                p[j] = (i < n)? v[i]: fc->addedPoints[i - n];
+            }
+            if (!(q = addQuad(numbQuads++))) return -1;
+            for (j = 0; j < 4; j++) {
+                q->x[j] = p[(j < 3)? j: 2].x;
+                q->y[j] = p[(j < 3)? j: 2].y;
+            }
+            if (area(q->x, q->y, 3) > eps * eps) {
+                snprintf(problem, sizeof(problem), "triangle %d counterclockwise", k);
+                return -1;
+            }
+        }
+        return numbQuads;
+    }
+
+    for (k = 0; k < fc->numbWs; k++) {
+        s = &fc->ws[k];
+        xl = xr = s->x;
+        yt = s->y;
+        lSlope = rSlope = 0;
+        for (i = 0; i < s->numbWe; i++, yt -= h) {
+            e = &fc->we[s->firstWe + i];
+            type = e->wedgeType & ~LAST_WE;
+            if (type != RIGHT) {
+                xl += e->lCorr;
+                lSlope = e->lSlope;
+            }
+            if (type != LEFT) {
+                xr += e->rCorr;
+                rSlope = e->rSlope;
+            }
+            h = e->height;
+            if ((numbQuads = addWedge(numbQuads, xl, xr, lSlope, rSlope, yt, h, eps, i, k)) < 0) return -1;
+            xl -= lSlope * h;
+            xr -= rSlope * h;
+        }
+    }
+    return numbQuads;
+}
+/*-------------------------------------------------------*/
+static int storedQuads(const void *data, double eps)
+{
+/* The wedge elements of a store written by storeWedges() as quads, in
+ * coordinates, read in 32-bit floats as fillStore() reads them. Returns
+ * their number, or -1 with problem set if one is wrong. */
+    const StoreHeader *hd = (const StoreHeader*)data;
+    const char *p = (const char*)(hd + 1);
+    const StoredSequence *s;
+    const unsigned char *types;
+    const float *val;
+    const unsigned short *half;
+    float xl, xr, lSlope, rSlope, yt, yb;
+    unsigned i, k;
+    int numbQuads = 0, halfSlopes = hd->flags & STORE_HALF_SLOPES;
+
+    for (k = 0; k < hd->numbWs; k++, p += s->size) {
+        s = (const StoredSequence*)p;
+        types = (const unsigned char*)(s + 1);
+        val = (const float*)(types + ((s->numbWe + 3) & ~3u));
+        half = (const unsigned short*)(val + s->numbValues);
+        xl = xr = s->x;
+        yt = s->y;
+        lSlope = rSlope = 0;
+        for (i = 0; i < s->numbWe; i++, yt = yb) {
+            yb = yt - *val++;
+            if (types[i] != RIGHT) {
+                xl += *val++;
+                lSlope = halfSlopes? halfToFloat(*half++): *val++;
+            }
+            if (types[i] != LEFT) {
+                xr += *val++;
+                rSlope = halfSlopes? halfToFloat(*half++): *val++;
+            }
+            numbQuads = addWedge(numbQuads, xl * PIXEL, xr * PIXEL, lSlope, rSlope, yt * PIXEL,
+                                 (yt - yb) * PIXEL, eps, (int)i, (int)k);
+            if (numbQuads < 0) return -1;
+            xl -= lSlope * (yt - yb);
+            xr -= rSlope * (yt - yb);
+        }
+    }
+    return numbQuads;
+}
+/*-------------------------------------------------------*/
+static int inQuad(const Quad *q, double x, double y, double eps)
+{
+/* 1 if (x, y) is inside q, 0 if outside, -1 if too close to tell */
+    double dx, dy, len, c;
+    int i, j, near = 0, left = 0, right = 0, below = 0, above = 0;
+
+    for (i = 0; i < 4; i++) {
+        left += (q->x[i] < x - eps);
+        right += (q->x[i] > x + eps);
+        below += (q->y[i] < y - eps);
+        above += (q->y[i] > y + eps);
+    }
+    if (left == 4 || right == 4 || below == 4 || above == 4) return 0;
+
+    for (i = 0, j = 3; i < 4; j = i++) {
+        dx = q->x[i] - q->x[j];
+        dy = q->y[i] - q->y[j];
+        len = sqrt(dx * dx + dy * dy);
+        if (len < eps) continue; /* the corners of a wedge come to a point */
+        c = dx * (y - q->y[j]) - dy * (x - q->x[j]); /* negative on the right, inside */
+        if (c > eps * len) return 0;
+        if (c > -eps * len) near = 1;
+    }
+    return near? -1: 1;
+}
+/*-------------------------------------------------------*/
+static int sameSequences(const WedgeSequence aWs[], const WedgeElement aWe[], const WedgeSequence bWs[],
+                         const WedgeElement bWe[], int numbWs)
+{
+/* Whether the wedge sequences aWs[0 .. numbWs-1], with their elements in
+ * aWe, are those of bWs, with theirs in bWe, in the fields that their
+ * types use */
+    const WedgeSequence *a, *b;
+    const WedgeElement *e, *f;
+    int i, k, type;
+
+    for (k = 0; k < numbWs; k++) {
+        a = &aWs[k];
+        b = &bWs[k];
+        if (a->opcode != b->opcode || a->x != b->x || a->y != b->y || a->pwidth != b->pwidth ||
+            a->pht != b->pht || a->numbWe != b->numbWe)
+            return 0;
+        for (i = 0; i < a->numbWe; i++) {
+            e = &aWe[a->firstWe + i];
+            f = &bWe[b->firstWe + i];
+            type = e->wedgeType & ~LAST_WE;
+            if (e->wedgeType != f->wedgeType || e->height != f->height ||
+                (type != RIGHT && (e->lCorr != f->lCorr || e->lSlope != f->lSlope)) ||
+                (type != LEFT && (e->rCorr != f->rCorr || e->rSlope != f->rSlope)))
+                return 0;
+        }
+    }
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int sameStrip(const FillContext *fc, int s)
+{
+/* Whether strip s has the wedge sequences it had in keptWs and keptWe */
+    if (fc->stripWs[s+1] - fc->stripWs[s] != keptStripWs[s+1] - keptStripWs[s]) return 0;
+    return sameSequences(keptWs + keptStripWs[s], keptWe, fc->ws + fc->stripWs[s], fc->we,
+                         keptStripWs[s+1] - keptStripWs[s]);
+}
+/*-------------------------------------------------------*/
+static int samePolys(const FillContext *fc, Point v[], const int ringOffsets[], int numbPolys,
+                     const int wsOffsets[])
+{
+/* Whether fillPolys() left in fc for each polygon v[ringOffsets[k] ..
+ * ringOffsets[k+1]-1] what fillPoly() makes of it. Returns 1, or 0 with
+ * problem set. */
+    int k, status;
+
+    alone.cleanInput = fc->cleanInput;
+    alone.fillRule = fc->fillRule;
+    for (k = 0; k < numbPolys; k++) {
+        status = fillPoly(&alone, ringOffsets[k+1] - ringOffsets[k], v + ringOffsets[k]);
+        if (status < 0) {
+            snprintf(problem, sizeof(problem), "fillPoly() returned %d for polygon %d", status, k);
+            return 0;
+        }
+        if (status != wsOffsets[k+1] - wsOffsets[k] ||
+            !sameSequences(alone.ws, alone.we, fc->ws + wsOffsets[k], fc->we, status)) {
+            snprintf(problem, sizeof(problem), "polygon %d of %d not as by fillPoly()", k, numbPolys);
+            return 0;
+        }
+    }
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int fillMoved(FillContext *fc, Point v[], int n)
+{
+/*----------------------------------------------
+ * Decompose the polygon v[0 .. n-1] by fillStrips() with its middle
+ * vertex halfway between its neighbours, then by moveVertices() moving
+ * it back. Returns as moveVertices(), or -2 with problem set if a strip
+ * that the move does not go through changed, or (with FILL_STATS) was
+ * decomposed again.
+ */
+    Point to;
+    Coord ylo, yhi;
+    int i = n/2, h = (i + n - 1) % n, j = (i + 1) % n, k, s, s0, s1, status, ringOffsets[2];
+
+    ringOffsets[0] = 0;
+    ringOffsets[1] = n;
+    to = v[i];
+    v[i].x = v[h].x + (v[j].x - v[h].x)/2;
+    v[i].y = v[h].y + (v[j].y - v[h].y)/2;
+    status = fillStrips(fc, 1, v, ringOffsets, 1 + n % MAX_STRIPS);
+    if (status < 0) {
+        v[i] = to;
+        return status;
+    }
+
+    /* what it made, and the strips that the move goes through */
+    if (fc->numbWs > maxKeptWs || fc->numbWe > maxKeptWe) {
+        free(keptWs);
+        free(keptWe);
+        maxKeptWs = 2*fc->numbWs;
+        maxKeptWe = 2*fc->numbWe;
+        keptWs = (WedgeSequence*) malloc(maxKeptWs * sizeof(WedgeSequence));
+        keptWe = (WedgeElement*) malloc(maxKeptWe * sizeof(WedgeElement));
+        if (!keptWs || !keptWe) {
+            maxKeptWs = maxKeptWe = 0;
+            v[i] = to;
+            snprintf(problem, sizeof(problem), "out of memory");
+            return -2;
+        }
+    }
+    memcpy(keptWs, fc->ws, fc->numbWs * sizeof(WedgeSequence));
+    memcpy(keptWe, fc->we, fc->numbWe * sizeof(WedgeElement));
+    memcpy(keptStripWs, fc->stripWs, (fc->numbStrips + 1) * sizeof(int));
+    ylo = fmin(fmin(v[h].y, v[j].y), fmin(v[i].y, to.y));
+    yhi = fmax(fmax(v[h].y, v[j].y), fmax(v[i].y, to.y));
+    for (s0 = 0; s0 < fc->numbStrips - 1 && fc->strips[s0+1] >= yhi; s0++) ;
+    for (s1 = s0; s1 < fc->numbStrips - 1 && fc->strips[s1+1] > ylo; s1++) ;
+
+    status = moveVertices(fc, 1, v, ringOffsets, 1, &i, &to);
+    if (status < 0) return status;
+    for (s = 0; s < fc->numbStrips; s++)
+        if ((s < s0 || s > s1) && !sameStrip(fc, s)) {
+            snprintf(problem, sizeof(problem), "moveVertices() changed strip %d of %d", s, fc->numbStrips);
+            return -2;
+        }
+#ifdef FILL_STATS
+    for (k = 0, s = fc->stripWs[s0]; s < fc->stripWs[s1+1]; s++) k += fc->ws[s].numbWe;
+    if (fc->stats.wedges != k) {
+        snprintf(problem, sizeof(problem), "moveVertices() made %d wedges for %d", (int)fc->stats.wedges, k);
+        return -2;
+    }
+#else
+    (void)k;
+#endif
+    return status;
+}
+/*-------------------------------------------------------*/
+static int check(FillContext *fc, Mode mode, const Vertex gv[], const int ringOffsets[], int numbRings)
+{
+/*----------------------------------------------
+ * Decompose the rings gv (ring k at gv[ringOffsets[k] ..
+ * ringOffsets[k+1]-1]) by mode and check what is made.
+ * Returns 0, or 1 with what is wrong in problem.
+ */
+    static Point v[MAX_POINTS];
+    static double px[MAX_POINTS], py[MAX_POINTS];
+    double cx[MAX_CLIPPED], cy[MAX_CLIPPED], rx[4], ry[4],
+           xmin, xmax, ymin, ymax, size, eps, tolerance, near, x, y, expected, made, allowed, seconds;
+    int i, j, k, m, c, status, numbQuads, in, covered, wsOffsets[MAX_RINGS + 1], n = ringOffsets[numbRings],
+        samples = (mode == LARGE)? LARGE_SAMPLES: SAMPLES, crossing = (mode == EVEN_ODD_RINGS || mode == NON_ZERO_RINGS);
+    size_t storeSize;
+    clock_t started;
+
+    if (n < 1) return 0;
+    for (i = 0; i < n; i++) {
+        v[i].x = COORD(gv[i].x);
+        v[i].y = COORD(gv[i].y);
+        px[i] = v[i].x;
+        py[i] = v[i].y;
+    }
+    xmin = xmax = px[0];
+    ymin = ymax = py[0];
+    for (i = 1; i < n; i++) {
+        xmin = fmin(xmin, px[i]);
+        xmax = fmax(xmax, px[i]);
+        ymin = fmin(ymin, py[i]);
+        ymax = fmax(ymax, py[i]);
+    }
+    size = fmax(xmax - xmin, ymax - ymin);
+    eps = fmax(1e-4 * size, ROUNDING);
+    if (mode == STORED && n % 2) eps = fmax(eps, size / 1024); /* each side of 16-bit slope */
+
+    fc->triangulate = (mode == TRIANGLES || (mode == HOLES && numbRings % 2 == 0));
+    fc->cleanInput = (mode == CLEANED || (mode == POLYS && n % 2));
+    fc->fillRule = (mode == FILLED || mode == NON_ZERO_RINGS)? NON_ZERO: (mode == EVEN_ODD_RINGS)? EVEN_ODD: ORIENTED;
+    fc->tolerance = (mode == SIMPLIFIED)? tolerances[n % 4]: (mode == LARGE && n % 2)? 1: 0;
+    tolerance = fc->tolerance * PIXEL;
+    fc->clip = (mode == CLIPPED);
+    if (fc->clip) { /* the middle half of the bounding box */
+        fc->clipMin.x = (Coord)(xmin + (xmax - xmin) / 4);
+        fc->clipMin.y = (Coord)(ymin + (ymax - ymin) / 4);
+        fc->clipMax.x = (Coord)(xmax - (xmax - xmin) / 4);
+        fc->clipMax.y = (Coord)(ymax - (ymax - ymin) / 4);
+    }
+
+    caseMode = mode;
+    caseCall = (mode == STRIPS)? "moveVertices()": (mode == POLYS)? "fillPolys()": (mode == SLABS)? "fillSlabs()":
+               (numbRings > 1)? "fillRings()": "fillPoly()";
+    started = clock();
+    alarm(TIME_LIMIT);
+    if (mode == STRIPS) status = fillMoved(fc, v, n);
+    else if (mode == POLYS) status = fillPolys(fc, numbRings, v, ringOffsets, wsOffsets, 1 + n % MAX_THREADS);
+    else if (mode == SLABS) status = fillSlabs(fc, numbRings, v, ringOffsets, 2 + n % (MAX_THREADS - 1));
+    else status = (numbRings > 1)? fillRings(fc, numbRings, v, ringOffsets): fillPoly(fc, n, v);
+    alarm(0);
+    seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+    if (status == -2 && mode == STRIPS) return 1;
+    if (status < 0) {
+        snprintf(problem, sizeof(problem), "%s returned %d", caseCall, status);
+        return 1;
+    }
+    if (mode == LARGE && seconds > LARGE_TIME) {
+        snprintf(problem, sizeof(problem), "%s took %.2f s", caseCall, seconds);
+        return 1;
+    }
+    if (mode == POLYS) return !samePolys(fc, v, ringOffsets, numbRings, wsOffsets);
+
+    if (mode == STORED) {
+        storeSize = storeWedges(fc, (n % 2)? STORE_HALF_SLOPES: 0, NULL, 0);
+        if (storeSize > maxStore) {
+            free(store);
+            maxStore = 2 * storeSize;
+            if (!(store = (char*) malloc(maxStore))) {
+                maxStore = 0;
+                snprintf(problem, sizeof(problem), "out of memory");
+                return 1;
+            }
+        }
+        if (storeWedges(fc, (n % 2)? STORE_HALF_SLOPES: 0, store, maxStore) != storeSize ||
+            checkStore(store, storeSize) != fc->numbWs) {
+            snprintf(problem, sizeof(problem), "store of %d wedge sequences not valid", fc->numbWs);
+            return 1;
+        }
+        numbQuads = storedQuads(store, eps);
+    } else
+        numbQuads = collectQuads(fc, v, n, (ROUNDING > 0 && crossing)? HUGE_VAL: eps + 2 * tolerance);
+    if (numbQuads < 0) return 1;
+
+    /* the area, of the part in the clip rectangle if clipped, unless the
+     * rings cross */
+    allowed = 1e-5 * size * size + numbQuads * size * ROUNDING;
+    if (mode == STORED && n % 2) allowed += numbQuads * size * size / 2048;
+    if (fc->clip) {
+        memcpy(cx, px, n * sizeof(double));
+        memcpy(cy, py, n * sizeof(double));
+        m = clipSide(cx, cy, n, 0, fc->clipMin.x, 0);
+        m = clipSide(cx, cy, m, 0, fc->clipMax.x, 1);
+        m = clipSide(cx, cy, m, 1, fc->clipMin.y, 0);
+        m = clipSide(cx, cy, m, 1, fc->clipMax.y, 1);
+        expected = -area(cx, cy, m);
+    } else
+        for (k = 0, expected = 0; k < numbRings; k++) {
+            i = ringOffsets[k];
+            expected -= area(px + i, py + i, ringOffsets[k+1] - i);
+            for (j = ringOffsets[k+1] - 1; i < ringOffsets[k+1]; j = i++) /* moved by up to the tolerance */
+                allowed += tolerance * hypot(px[i] - px[j], py[i] - py[j]);
+        }
+    for (k = 0, made = 0; k < numbQuads; k++) made -= area(quads[k].x, quads[k].y, 4);
+    if (!crossing && fabs(made - expected) > allowed) {
+        snprintf(problem, sizeof(problem), "area %g made for %g", made, expected);
+        return 1;
+    }
+
+    /* the coverage of points away from the edges */
+    rx[0] = rx[3] = fc->clipMin.x;
+    rx[1] = rx[2] = fc->clipMax.x;
+    ry[0] = ry[1] = fc->clipMin.y;
+    ry[2] = ry[3] = fc->clipMax.y;
+    near = eps + 1.5 * tolerance;
+    for (i = 0; i < samples; i++)
+        for (j = 0; j < samples; j++) {
+            x = xmin + (xmax - xmin) * (i + .37) / samples;
+            y = ymin + (ymax - ymin) * (j + .61) / samples;
+            if (fc->clip && nearEdge(x, y, rx, ry, 4, eps)) continue;
+            for (k = 0; k < numbRings && !nearEdge(x, y, px + ringOffsets[k], py + ringOffsets[k],
+                                                   ringOffsets[k+1] - ringOffsets[k], near); k++) ;
+            if (k < numbRings) continue;
+            in = winding(x, y, px, py, ringOffsets, numbRings);
+            in = ((fc->fillRule == EVEN_ODD)? in % 2: in) != 0 && (!fc->clip || inside(x, y, rx, ry, 4));
+            for (k = 0, covered = 0; k < numbQuads && covered >= 0; k++) {
+                c = inQuad(&quads[k], x, y, eps);
+                covered = (c < 0)? -1: covered + c;
+            }
+            if (covered >= 0 && covered != in) {
+                snprintf(problem, sizeof(problem), "point (%g, %g) covered %d times", x, y, covered);
+                return 1;
+            }
+        }
+    return 0;
+}
+/*-------------------------------------------------------*/
+static int shrink(FillContext *fc, Mode mode, Vertex v[], int ringOffsets[], int numbRings)
+{
+/* Leave vertices out of the rings v, which fail in mode, while they stay
+ * input of mode and still fail. Returns the vertices left. */
+    Vertex w[MAX_SHRUNK];
+    int i, k, r, wOffsets[MAX_RINGS + 1], n = ringOffsets[numbRings];
+
+    for (i = 0; i < n; i++) {
+        for (r = 0; ringOffsets[r+1] <= i; r++) ;
+        if (ringOffsets[r+1] - ringOffsets[r] <= 3) continue;
+        memcpy(w, v, i * sizeof(Vertex));
+        memcpy(w + i, v + i + 1, (n - i - 1) * sizeof(Vertex));
+        for (k = 0; k <= numbRings; k++) wOffsets[k] = ringOffsets[k] - (k > r);
+        if (fitsMode(mode, w, wOffsets, numbRings) && check(fc, mode, w, wOffsets, numbRings)) {
+            memcpy(v, w, (n - 1) * sizeof(Vertex));
+            memcpy(ringOffsets, wOffsets, (numbRings + 1) * sizeof(int));
+            n--;
+            i = -1;
+        }
+    }
+    return n;
+}
+/*-------------------------------------------------------*/
+static int makeCase(Mode mode, const Vertex p[], int n, int k, Vertex v[], int ringOffsets[])
+{
+/*----------------------------------------------
+ * Make the rings that mode decomposes for the polygon p[0 .. n-1] of
+ * case k, in v with ring j at v[ringOffsets[j] .. ringOffsets[j+1]-1].
+ * Returns the number of rings, or 0 if mode has none for this case.
+ */
+    int i, m, numbRings;
+
+    ringOffsets[0] = 0;
+    ringOffsets[1] = n;
+    switch (mode) {
+    case HOLES:
+    case SIMPLIFIED:
+        for (i = 0; i < n; i++) {
+            v[i].x = HOLE_SCALE * p[i].x;
+            v[i].y = HOLE_SCALE * p[i].y;
+        }
+        return addHoles(v, ringOffsets, 1);
+    case EVEN_ODD_RINGS:
+    case NON_ZERO_RINGS:
+        memcpy(v, p, n * sizeof(Vertex));
+        ringOffsets[2] = n + crossingRing(v + n, p, n);
+        return 2;
+    case POLYS:
+        memcpy(v, p, n * sizeof(Vertex));
+        for (numbRings = 1, m = 1 + xrand(MAX_POLYS); numbRings < m; numbRings++)
+            ringOffsets[numbRings + 1] = ringOffsets[numbRings] + randomPolygon(v + ringOffsets[numbRings], xrand);
+        return numbRings;
+    case SLABS:
+        do m = MIN_STAR + xrand(MAX_STAR - MIN_STAR + 1);
+        while (!randomStar(v, m, xrand(2)? 1024: 65536));
+        ringOffsets[1] = m;
+        return addHoles(v, ringOffsets, 1);
+    case LARGE:
+        if (k % LARGE_EVERY) return 0;
+        do ringOffsets[1] = LARGE_VERTICES + xrand(LARGE_VERTICES);
+        while (!randomStar(v, ringOffsets[1], LARGE_GRID));
+        return 1;
+    default:
+        memcpy(v, p, n * sizeof(Vertex));
+        return 1;
+    }
+}
+/*-------------------------------------------------------*/
+static void stopped(int sig)
+{
+/* A polygon on which the decomposition hangs or crashes cannot be
+ * shrunk: name it, to be run again by itself, and exit */
+    char s[128];
+    int k;
+
+    k = snprintf(s, sizeof(s), "%s, seed %u: %s %s\n", modeNames[caseMode], caseSeed, caseCall,
+                 (sig == SIGALRM)? "hangs": "crashes");
+    if (write(1, s, k) < 0) _exit(2);
+    _exit(1);
+}
+/*-------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    static Vertex w[MAX_POINTS];
+    FillContext fc;
+    Vertex v[MAX_VERTICES];
+    int numbCases, failed = 0, k, i, j, n, m, mode, numbRings, ringOffsets[MAX_RINGS + 1];
+
+    numbCases = (argc > 1)? atoi(argv[1]): 0;
+    if (numbCases <= 0) numbCases = 10000;
+    seed = (argc > 2)? (unsigned)strtoul(argv[2], NULL, 10): 0;
+    if (!seed) seed = 1;
+
+    signal(SIGALRM, stopped);
+    signal(SIGSEGV, stopped);
+    signal(SIGABRT, stopped);
+    initFillContext(&fc);
+    initFillContext(&alone);
+    for (k = 0; k < numbCases; k++) {
+        caseSeed = seed;
+        n = randomPolygon(v, irand);
+        moreSeed = caseSeed ^ 0x5bd1e995u;
+        for (mode = 0; mode < NUMB_MODES; mode++) {
+            numbRings = makeCase((Mode)mode, v, n, k, w, ringOffsets);
+            if (!numbRings || !check(&fc, (Mode)mode, w, ringOffsets, numbRings)) continue;
+            m = ringOffsets[numbRings];
+            printf("%s, seed %u (%d vertices): ", modeNames[mode], caseSeed, m);
+            if (mode == SLABS || mode == LARGE) {
+                printf("%s\n", problem);
+                fflush(stdout);
+                failed++;
+                continue;
+            }
+            shrink(&fc, (Mode)mode, w, ringOffsets, numbRings);
+            check(&fc, (Mode)mode, w, ringOffsets, numbRings);
+            printf("%s\n", problem);
+            for (j = 0; j < numbRings; j++) {
+                printf("  [");
+                for (i = ringOffsets[j]; i < ringOffsets[j+1]; i++)
+                    printf("%s[%d,%d]", (i > ringOffsets[j])? ",": "", w[i].x, w[i].y);
+                printf("]\n");
+            }
+            fflush(stdout);
+            failed++;
+        }
+    }
+    printf("%d polygons, %d failures\n", numbCases, failed);
+    freeFillContext(&fc);
+    freeFillContext(&alone);
+    free(quads);
+    free(keptWs);
+    free(keptWe);
+    free(store);
+    return failed != 0;
+}
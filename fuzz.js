@@ -0,0 +1,317 @@
+
+// Decomposes random simple polygons with hain() and sweep() of the JS
+// versions, and with hain() of the addon (addon.cpp) where it is built,
+// and checks what they make:
+//
+//   hain    its monotone pieces (see hain.monotone)
+//   sweep   the pieces its diagonals cut the polygon into; each diagonal
+//           must go through the inside from vertex to vertex, crossing
+//           no edge and no other diagonal
+//   addon   as many wedge sequences as hain() makes pieces
+//
+// The pieces must each be clockwise and y-monotone, have the area of the
+// polygon in all, and cover each of a grid of points over it once if it
+// is inside, else not at all. A polygon that fails is shrunk to the
+// fewest vertices that still fail, and printed. fuzz.cpp checks the
+// wedge sequences of fillPoly() on the same polygons (same generator,
+// same seeds):
+//
+//   node fuzz.js [cases [seed]]
+
+var addon = require('./hain'),
+    hain = addon.js || addon; // the JS version even where the addon is built
+var sweep = require('./sweep');
+
+var diagonals;
+
+global.drawPoly = function (points) { // both draw their diagonals when run in the browser
+    diagonals.push(points);
+};
+
+var seed = 1;
+
+function irand(k) {
+    seed = (Math.imul(seed, 1103515245) + 12345) >>> 0;
+    return (seed >>> 8) % k;
+}
+
+// exact for the integer coordinates of the polygons made
+function cross(a, b, c) {
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+function onSegment(p, a, b) {
+    return cross(a, b, p) === 0 &&
+        Math.min(a[0], b[0]) <= p[0] && p[0] <= Math.max(a[0], b[0]) &&
+        Math.min(a[1], b[1]) <= p[1] && p[1] <= Math.max(a[1], b[1]);
+}
+
+// whether the segments ab and cd have a point in common
+function intersect(a, b, c, d) {
+    var d1 = cross(c, d, a), d2 = cross(c, d, b),
+        d3 = cross(a, b, c), d4 = cross(a, b, d);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) return true;
+    return onSegment(a, c, d) || onSegment(b, c, d) || onSegment(c, a, b) || onSegment(d, a, b);
+}
+
+// [i, j] of two edges that meet other than at the vertex between them, or null
+function findCrossing(v) {
+    var n = v.length, i, j;
+    for (i = 0; i < n; i++)
+        for (j = i + 1; j < n; j++) {
+            var a = v[i], b = v[(i + 1) % n], c = v[j], d = v[(j + 1) % n];
+            if (j === i + 1) { // b === c
+                if (onSegment(a, c, d) || onSegment(d, a, b)) return [i, j];
+            } else if (i === 0 && j === n - 1) { // a === d
+                if (onSegment(b, c, d) || onSegment(c, a, b)) return [i, j];
+            } else if (intersect(a, b, c, d)) return [i, j];
+        }
+    return null;
+}
+
+function area(v) {
+    var s = 0;
+    for (var i = 0, j = v.length - 1; i < v.length; j = i++)
+        s += (v[j][0] - v[i][0]) * (v[j][1] + v[i][1]);
+    return s / 2; // positive if counterclockwise
+}
+
+// A simple clockwise polygon of 3 to 40 vertices on a grid of 8, 64 or
+// 65536, untangled from random points by reversing the part between two
+// edges that cross (2-opt); the small grids make many horizontal edges,
+// collinear vertices and vertices on the same x
+function randomPolygon() {
+    for (;;) {
+        var grid = [8, 64, 65536][irand(3)],
+            n = 3 + irand(grid === 8 ? 14 : 38),
+            v = [], used = {}, i, k, c;
+        while (v.length < n) {
+            var p = [irand(grid), irand(grid)];
+            if (used[p]) continue;
+            used[p] = true;
+            v.push(p);
+        }
+        for (k = 0; k < 8 * n * n && (c = findCrossing(v)); k++) {
+            if (c[1] === c[0] + 1 || c[1] === c[0] + n - 1) break; // edges along each other
+            var rev = v.slice(c[0] + 1, c[1] + 1).reverse();
+            for (i = 0; i < rev.length; i++) v[c[0] + 1 + i] = rev[i];
+        }
+        if (c || area(v) === 0) continue;
+        return area(v) > 0 ? v.reverse() : v;
+    }
+}
+
+function insidePolygon(p, v) {
+    var inside = false;
+    for (var i = 0, j = v.length - 1; i < v.length; j = i++)
+        if ((v[i][1] > p[1]) !== (v[j][1] > p[1]) &&
+            p[0] < v[i][0] + (p[1] - v[i][1]) * (v[j][0] - v[i][0]) / (v[j][1] - v[i][1]))
+            inside = !inside;
+    return inside;
+}
+
+function properCrossing(a, b, c, d) {
+    var d1 = cross(c, d, a), d2 = cross(c, d, b),
+        d3 = cross(a, b, c), d4 = cross(a, b, d);
+    return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+           ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+// whether the vertices go down then up (or up then down) at most once
+// each, horizontal edges left out
+function yMonotone(f) {
+    var turns = 0, last = 0, first = 0;
+    for (var i = 0; i < f.length; i++) {
+        var dy = f[(i + 1) % f.length][1] - f[i][1],
+            dir = dy > 0 ? 1 : dy < 0 ? -1 : 0;
+        if (!dir) continue;
+        if (!first) first = dir;
+        else if (dir !== last) turns++;
+        last = dir;
+    }
+    if (last !== first) turns++;
+    return turns <= 2;
+}
+
+// The pieces that diagonals cut polygon v into, or what is wrong with
+// the diagonals
+function cutPieces(v, diags) {
+    var n = v.length, links = [], i, j, k;
+
+    function index(p) {
+        for (var i = 0; i < n; i++)
+            if (v[i][0] === p[0] && v[i][1] === p[1]) return i;
+        return -1;
+    }
+
+    // neighbours of each vertex, along the ring and across the diagonals
+    for (i = 0; i < n; i++) links.push([(i + n - 1) % n, (i + 1) % n]);
+    for (k = 0; k < diags.length; k++) {
+        var s = index(diags[k][0]), t = index(diags[k][1]),
+            d = JSON.stringify(diags[k]);
+        if (s < 0 || t < 0) return 'diagonal ' + d + ' does not end on a vertex';
+        if (s === t || links[s].indexOf(t) >= 0) return 'diagonal ' + d + ' repeats an edge or diagonal';
+        if (!insidePolygon([(v[s][0] + v[t][0]) / 2, (v[s][1] + v[t][1]) / 2], v))
+            return 'diagonal ' + d + ' outside';
+        for (i = 0; i < n; i++)
+            if (i !== s && i !== t && (properCrossing(v[s], v[t], v[i], v[(i + 1) % n]) || onSegment(v[i], v[s], v[t])))
+                return 'diagonal ' + d + ' crosses an edge';
+        for (j = 0; j < k; j++)
+            if (properCrossing(diags[k][0], diags[k][1], diags[j][0], diags[j][1]))
+                return 'diagonals ' + d + ' and ' + JSON.stringify(diags[j]) + ' cross';
+        links[s].push(t);
+        links[t].push(s);
+    }
+
+    // from each edge going clockwise round the ring or across a diagonal,
+    // keep turning to the next link counterclockwise from the way back
+    var used = {}, pieces = [];
+    for (i = 0; i < n; i++)
+        for (j = 1; j < links[i].length; j++) { // links[i][0] goes the other way round the ring
+            var from = i, to = links[i][j], piece = [];
+            while (!used[from + ',' + to]) {
+                used[from + ',' + to] = true;
+                piece.push(v[from]);
+                var back = Math.atan2(v[from][1] - v[to][1], v[from][0] - v[to][0]),
+                    best = -1, bestTurn = 0;
+                for (k = 0; k < links[to].length; k++) {
+                    var w = links[to][k];
+                    if (w === from) continue;
+                    var turn = Math.atan2(v[w][1] - v[to][1], v[w][0] - v[to][0]) - back;
+                    while (turn <= 0) turn += 2 * Math.PI;
+                    if (best < 0 || turn < bestTurn) {
+                        best = w;
+                        bestTurn = turn;
+                    }
+                }
+                from = to;
+                to = best;
+            }
+            if (piece.length) pieces.push(piece);
+        }
+    if (pieces.length !== diags.length + 1)
+        return pieces.length + ' pieces for ' + diags.length + ' diagonals';
+    return pieces;
+}
+
+function nearEdge(p, f) {
+    for (var i = 0, j = f.length - 1; i < f.length; j = i++) {
+        var a = f[j], b = f[i],
+            dx = b[0] - a[0], dy = b[1] - a[1],
+            t = ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / (dx * dx + dy * dy);
+        t = t < 0 ? 0 : t > 1 ? 1 : t || 0;
+        if (Math.abs(a[0] + t * dx - p[0]) + Math.abs(a[1] + t * dy - p[1]) < 1e-6) return true;
+    }
+    return false;
+}
+
+// The first thing wrong with pieces (rings of [x, y]) as a decomposition
+// of polygon v, or null: each must be clockwise and y-monotone, they must
+// have the area of v in all, and cover each of 32x32 points spread over
+// it once if inside v and else not at all (leaving out points on an edge)
+function checkPieces(v, pieces) {
+    var total = 0, xmin = Infinity, xmax = -Infinity, ymin = Infinity, ymax = -Infinity, i, j, k;
+
+    if (typeof pieces === 'string') return pieces;
+    for (k = 0; k < pieces.length; k++) {
+        if (!(area(pieces[k]) < 0)) return 'piece ' + JSON.stringify(pieces[k]) + ' not clockwise';
+        if (!yMonotone(pieces[k])) return 'piece ' + JSON.stringify(pieces[k]) + ' not y-monotone';
+        total += area(pieces[k]);
+    }
+    if (Math.abs(total - area(v)) > 1e-9 * Math.abs(area(v)))
+        return 'pieces of area ' + total + ' for ' + area(v);
+
+    for (i = 0; i < v.length; i++) {
+        xmin = Math.min(xmin, v[i][0]);
+        xmax = Math.max(xmax, v[i][0]);
+        ymin = Math.min(ymin, v[i][1]);
+        ymax = Math.max(ymax, v[i][1]);
+    }
+    for (i = 0; i < 32; i++)
+        for (j = 0; j < 32; j++) {
+            var p = [xmin + (xmax - xmin) * (i + 0.37) / 32, ymin + (ymax - ymin) * (j + 0.61) / 32],
+                covered = 0;
+            if (nearEdge(p, v) || pieces.some(function (f) { return nearEdge(p, f); })) continue;
+            for (k = 0; k < pieces.length; k++)
+                if (insidePolygon(p, pieces[k])) covered++;
+            if (covered !== (insidePolygon(p, v) ? 1 : 0))
+                return 'point ' + JSON.stringify(p) + ' covered ' + covered + ' times';
+        }
+    return null;
+}
+
+// What is wrong with decomposer name on polygon v, or null
+var decomposers = {
+    hain: function (v) {
+        var pieces = [];
+        hain.monotone = function (p) {
+            var piece = [], q = p;
+            do {
+                piece.push([q.x, q.y]);
+                q = q.next;
+            } while (q !== p && piece.length <= 2 * v.length);
+            pieces.push(piece);
+        };
+        diagonals = [];
+        hain(v);
+        hain.monotone = null;
+        return checkPieces(v, pieces);
+    },
+    sweep: function (v) {
+        diagonals = [];
+        sweep(v.slice().reverse()); // sweep() takes the other orientation
+        return checkPieces(v, cutPieces(v, diagonals));
+    }
+};
+if (addon !== hain) decomposers.addon = function (v) {
+    var numbPieces = 0;
+    hain.monotone = function () {
+        numbPieces++;
+    };
+    diagonals = [];
+    hain(v);
+    hain.monotone = null;
+    var numbWs = addon(v);
+    return numbWs === numbPieces ? null :
+        numbWs + ' wedge sequences for ' + numbPieces + ' pieces of hain()';
+};
+
+function run(name, v) {
+    try {
+        return decomposers[name](v);
+    } catch (e) {
+        return String(e);
+    }
+}
+
+// v with vertices left out while it stays simple and still fails
+function shrink(name, v) {
+    for (var i = 0; i < v.length && v.length > 3; i++) {
+        var w = v.slice(0, i).concat(v.slice(i + 1));
+        if (area(w) < 0 && !findCrossing(w) && run(name, w)) {
+            v = w;
+            i = -1;
+        }
+    }
+    return v;
+}
+
+var numbCases = +process.argv[2] || 10000,
+    failed = 0;
+
+seed = +process.argv[3] || 1;
+
+for (var c = 0; c < numbCases; c++) {
+    var caseSeed = seed,
+        v = randomPolygon();
+    for (var name in decomposers) {
+        if (!run(name, v)) continue;
+        var w = shrink(name, v);
+        console.log(name + ', seed ' + caseSeed + ' (' + v.length + ' vertices): ' + run(name, w) +
+            '\n  ' + JSON.stringify(w));
+        failed++;
+    }
+}
+console.log(numbCases + ' polygons, ' + failed + ' failures');
+process.exitCode = failed ? 1 : 0;
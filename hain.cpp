@@ -4,523 +4,3489 @@
  */
 
 #include <limits.h>
+#include <string.h>
 #include "hain.h"
+#ifdef FILL_STATS
+#include <chrono>
+#endif
+
+/* Fields of chain node p, and the node of vertex i of the loop. These
+ * expect the FillContext in fc. */
+#ifdef INDEX_NODES
+#define X(p) (fc->nodes.x[p])
+#define Y(p) (fc->nodes.y[p])
+#define DELTAY(p) (fc->nodes.deltay[p])
+#define JOINTYPE(p) (fc->nodes.joinType[p])
+#define PREV(p) (fc->nodes.prev[p])
+#define NEXT(p) (fc->nodes.next[p])
+#define NEXTJOIN(p) (fc->nodes.nextJoin[p])
+#define PREVJOIN(p) (fc->nodes.prevJoin[p])
+#define VERTEX(i) (i)
+#define VERTEX_INDEX(p) (p)
+#else
+#define X(p) ((p)->x)
+#define Y(p) ((p)->y)
+#define DELTAY(p) ((p)->deltay)
+#define JOINTYPE(p) ((p)->joinType)
+#define PREV(p) ((p)->prev)
+#define NEXT(p) ((p)->next)
+#define NEXTJOIN(p) ((p)->nextJoin)
+#define PREVJOIN(p) ((p)->prevJoin)
+#define VERTEX(i) (fc->nodes + (i))
+#define VERTEX_INDEX(p) ((int)((p) - fc->nodes))
+#endif
+/* in functions that only pass fc to the macros above, which use it in
+ * one of the two layouts */
+#define USES_NODES(fc) ((void)(fc))
+
+/* x at height yy of the up-edge in treap node t */
+#define XAT(t, yy) ((t)->x + (t)->slope * ((yy) - (t)->y))
+/* q starts or ends a window chain */
+#define IS_JOIN(q) (PREVJOIN(q) != NIL && NEXTJOIN(PREVJOIN(q)) == (q))
+/* edge (index of its lower vertex) that a piece of an up-edge belongs to */
+#define EDGE_OF(p) ((JOINTYPE(p) & ADDED_NODE)? \
+                    fc->addedEdges[(p) - fc->addedNodes]: VERTEX_INDEX(p))
+/* nodes p and q are at the same point */
+#define SAME_POINT(p, q) (X(p) == X(q) && Y(p) == Y(q))
+/* node p comes after q going up (by y, then x) */
+#define ABOVE(p, q) (Y(p) > Y(q) || (Y(p) == Y(q) && X(p) > X(q)))
+/* index of the output vertex at node p (triangulate mode) */
+#define VERTEX_OF(p) ((JOINTYPE(p) & ADDED_NODE)? fc->addedVertex[(p) - fc->addedNodes]: \
+                      VERTEX_INDEX(p) < fc->numbVertices? VERTEX_INDEX(p): \
+                      fc->bridgeVertex[VERTEX_INDEX(p) - fc->numbVertices])
+/* key of a coordinate (see coordKey), and byte b of the sort key of JoinKey k */
+#ifdef DOUBLE_COORDS
+typedef unsigned long long CoordKey;
+#define KEY_BYTES 16
+#define KEY_BYTE(k, b) ((int)((((b) < 8)? (k).low: (k).key) >> 8*((b) & 7)) & 0xff)
+#define KEY_LESS(k, l) ((k).key < (l).key || ((k).key == (l).key && (k).low < (l).low))
+#else
+typedef unsigned CoordKey;
+#define KEY_BYTES 8
+#define KEY_BYTE(k, b) ((int)((k).key >> 8*(b)) & 0xff)
+#define KEY_LESS(k, l) ((k).key < (l).key)
+#endif
+/* cross product of coordinate differences: exact for FIXED_COORDS */
+#ifdef FIXED_COORDS
+typedef long long Cross;
+#else
+typedef Coord Cross;
+#endif
+/* largest coordinate */
+#if defined(FIXED_COORDS)
+#define COORD_MAX INT_MAX
+#elif defined(DOUBLE_COORDS)
+#define COORD_MAX DBL_MAX
+#else
+#define COORD_MAX FLT_MAX
+#endif
+/* fc->tolerance in coordinate units */
+#ifdef FIXED_COORDS
+#define TOLERANCE(fc) ((fc)->tolerance * (1 << FIXED_SHIFT))
+#else
+#define TOLERANCE(fc) ((fc)->tolerance)
+#endif
+/* statement x, only done with FILL_STATS */
+#ifdef FILL_STATS
+#define STATS(x) x
+#else
+#define STATS(x)
+#endif
+/* reflex join with PEAK same as DOWNTORIGHT, whose window has to be searched for */
+#define IS_SPLIT(jt) (((jt) & POSCROSSPROD) && \
+                      ((jt) & (PEAK|DOWNTORIGHT)) != PEAK && ((jt) & (PEAK|DOWNTORIGHT)) != DOWNTORIGHT)
+
+void initFillContext(FillContext *fc)
+{
+    fc->ws = NULL;
+    fc->we = NULL;
+    fc->numbWs = fc->maxWs = 0;
+    fc->numbWe = fc->maxWe = 0;
+    fc->sink = NULL;
+    fc->sinkData = NULL;
+    fc->numbSunk = 0;
+    fc->triangulate = 0;
+    fc->triangles = NULL;
+    fc->addedPoints = NULL;
+    fc->numbTriangles = fc->maxTriangles = 0;
+    fc->numbAddedPoints = fc->maxAddedPoints = 0;
+    fc->addedVertex = NULL;
+    fc->monoStack = NULL;
+    fc->maxAddedVertex = fc->maxMonoStack = 0;
+    fc->bridgeVertex = NULL;
+    fc->maxBridgeVertex = 0;
+    fc->cleanInput = 0;
+    fc->ringInfo = NULL;
+    fc->maxRingInfo = 0;
+    fc->fillRule = ORIENTED;
+    fc->fillEdges = NULL;
+    fc->activeEdges = NULL;
+    fc->trapezoids = NULL;
+    fc->crossings = NULL;
+    fc->maxFillEdges = fc->maxActive = fc->maxTrapezoids = fc->maxCrossings = 0;
+    fc->strips = NULL;
+    fc->stripWs = NULL;
+    fc->numbStrips = fc->maxStrips = fc->maxStripWs = 0;
+    fc->stripLists = fc->edgeStamps = NULL;
+    fc->stripEdges = NULL;
+    fc->numbStripEdges = fc->moveStamp = 0;
+    fc->freeStripEdge = -1;
+    fc->maxStripLists = fc->maxStripEdges = fc->maxEdgeStamps = 0;
+    fc->clip = 0;
+    fc->clipMin.x = fc->clipMin.y = fc->clipMax.x = fc->clipMax.y = 0;
+    fc->clipPoints = NULL;
+    fc->clipOffsets = fc->clipVertices = NULL;
+    fc->clipPieces = NULL;
+    fc->maxClipPoints = fc->maxClipOffsets = fc->maxClipVertices = fc->maxClipPieces = 0;
+    fc->tolerance = 0;
+    fc->simplePoints = NULL;
+    fc->simpleOffsets = NULL;
+    fc->alignedYs = NULL;
+    fc->maxSimplePoints = fc->maxSimpleOffsets = fc->maxAlignedYs = 0;
+#ifdef INDEX_NODES
+    fc->nodes.x = fc->nodes.y = fc->nodes.deltay = NULL;
+    fc->nodes.joinType = NULL;
+    fc->nodes.prev = fc->nodes.next = fc->nodes.nextJoin = fc->nodes.prevJoin = NULL;
+    fc->addedNodes = 0;
+#else
+    fc->nodes = fc->addedNodes = NULL;
+#endif
+    fc->rings = NULL;
+    fc->numbVertices = fc->maxRings = 0;
+    fc->sortedJoins = NULL;
+    fc->joinKeys = NULL;
+    fc->maxNodes = fc->maxAdded = fc->maxJoins = fc->maxJoinKeys = 0;
+    fc->splitJoins = NULL;
+    fc->sweepChains = NULL;
+    fc->treapNodes = NULL;
+    fc->rayHits = fc->addedEdges = NULL;
+    fc->maxSplits = fc->maxSweep = fc->maxTreap = fc->maxRayHits = fc->maxAddedEdges = 0;
+    STATS(memset(&fc->stats, 0, sizeof(fc->stats)));
+}
+/*-------------------------------------------------------*/
+void freeFillContext(FillContext *fc)
+{
+    free(fc->ws);
+    free(fc->we);
+#ifdef INDEX_NODES
+    free(fc->nodes.x);
+    free(fc->nodes.y);
+    free(fc->nodes.deltay);
+    free(fc->nodes.joinType);
+    free(fc->nodes.prev);
+    free(fc->nodes.next);
+    free(fc->nodes.nextJoin);
+    free(fc->nodes.prevJoin);
+#else
+    free(fc->nodes);
+    free(fc->addedNodes);
+#endif
+    free(fc->sortedJoins);
+    free(fc->joinKeys);
+    free(fc->splitJoins);
+    free(fc->sweepChains);
+    free(fc->treapNodes);
+    free(fc->rayHits);
+    free(fc->addedEdges);
+    free(fc->triangles);
+    free(fc->addedPoints);
+    free(fc->addedVertex);
+    free(fc->monoStack);
+    free(fc->bridgeVertex);
+    free(fc->ringInfo);
+    free(fc->fillEdges);
+    free(fc->activeEdges);
+    free(fc->trapezoids);
+    free(fc->crossings);
+    free(fc->strips);
+    free(fc->stripWs);
+    free(fc->stripLists);
+    free(fc->stripEdges);
+    free(fc->edgeStamps);
+    free(fc->clipPoints);
+    free(fc->clipOffsets);
+    free(fc->clipVertices);
+    free(fc->clipPieces);
+    free(fc->simplePoints);
+    free(fc->simpleOffsets);
+    free(fc->alignedYs);
+    free(fc->rings);
+    initFillContext(fc);
+}
+/*-------------------------------------------------------*/
+#ifdef FILL_STATS
+const char *phaseNames[NUMB_PHASES] = {
+    "clip rings", "simplify rings", "build rings", "sweep bands", "clean rings", "link holes",
+    "remove collinear", "collect joins", "sort joins", "find windows", "process joins", "emit pieces"
+};
+
+static double statsTime(void)
+{
+/* Seconds since a fixed time */
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+/*-------------------------------------------------------*/
+static void endPhase(FillContext *fc, Phase ph, double *start)
+{
+/* Add the time since *start to phase ph, and start the next phase */
+    double t = statsTime();
+
+    fc->stats.seconds[ph] += t - *start;
+    *start = t;
+}
+/*-------------------------------------------------------*/
+static void countJoin(FillContext *fc, JoinType joinType)
+{
+    fc->stats.joins++;
+    if (joinType & PEAK) fc->stats.peaks++;
+    if (joinType & DCUSP) fc->stats.dcusps++;
+    if (joinType & UCUSP) fc->stats.ucusps++;
+    if (joinType & POSCROSSPROD) fc->stats.posCrossProds++;
+}
+/*-------------------------------------------------------*/
+#endif
+static int growBuffer(void **buf, int *max, int numb, int minSize, size_t size)
+{
+/* Make room for at least numb elements of the given size in *buf,
+ * at least doubling its size. Contents are preserved.
+ * Returns -1 if out of memory. */
+    int newMax;
+    void *tmp;
+
+    if (numb <= *max) return 0;
+    newMax = *max? 2 * *max: minSize;
+    if (newMax < numb) newMax = numb;
+    tmp = realloc(*buf, newMax * size);
+    if (!tmp) return -1;
+    *buf = tmp;
+    *max = newMax;
+    return 0;
+}
+/*-------------------------------------------------------*/
+int reserveWedges(FillContext *fc, int numbWs, int numbWe)
+{
+/* Make room for at least numbWs wedge sequences and numbWe wedge elements.
+ * Returns -1 if out of memory. */
+    if (growBuffer((void**)&fc->ws, &fc->maxWs, numbWs, NUMB_WS, sizeof(WedgeSequence)))
+        return -1;
+    return growBuffer((void**)&fc->we, &fc->maxWe, numbWe, NUMB_WE, sizeof(WedgeElement));
+}
+/*-------------------------------------------------------*/
+static int reserveNodes(FillContext *fc, int n, int numbAdded)
+{
+/* Make room for the n nodes of the vertex loop and numbAdded ADDED_NODEs.
+ * Contents are preserved. Returns -1 if out of memory. */
+#ifdef INDEX_NODES
+    ChainNodes *nd = &fc->nodes;
+    int numb = n + numbAdded, max = fc->maxNodes;
+
+    fc->addedNodes = n;
+    if (numb <= max) return 0;
+    if (growBuffer((void**)&nd->x, &max, numb, numb, sizeof(Coord)) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->y, &max, numb, numb, sizeof(Coord))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->deltay, &max, numb, numb, sizeof(Coord))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->joinType, &max, numb, numb, sizeof(JoinType))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->prev, &max, numb, numb, sizeof(NodeRef))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->next, &max, numb, numb, sizeof(NodeRef))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->nextJoin, &max, numb, numb, sizeof(NodeRef))) ||
+        (max = fc->maxNodes, growBuffer((void**)&nd->prevJoin, &max, numb, numb, sizeof(NodeRef))))
+        return -1;
+    fc->maxNodes = max;
+    return 0;
+#else
+    return growBuffer((void**)&fc->nodes, &fc->maxNodes, n, n, sizeof(ChainNode)) ||
+           growBuffer((void**)&fc->addedNodes, &fc->maxAdded, numbAdded, numbAdded, sizeof(ChainNode))? -1: 0;
+#endif
+}
+/*-------------------------------------------------------*/
+static unsigned treapPriority(unsigned i)
+{
+/* Fixed pseudo-random heap order, so the output does not depend on any state */
+    i ^= i >> 16;
+    i *= 0x45d9f3bu;
+    i ^= i >> 16;
+    i *= 0x45d9f3bu;
+    return i ^ (i >> 16);
+}
+/*-------------------------------------------------------*/
+static void rotateUp(TreapNode **root, TreapNode *t)
+{
+/* Rotate t above its parent, keeping the in-order sequence. */
+    TreapNode *p = t->parent, *g = p->parent;
+
+    if (t == p->left) {
+        p->left = t->right;
+        if (t->right) t->right->parent = p;
+        t->right = p;
+    } else {
+        p->right = t->left;
+        if (t->left) t->left->parent = p;
+        t->left = p;
+    }
+    p->parent = t;
+    t->parent = g;
+    if (!g) *root = t;
+    else if (g->left == p) g->left = t;
+    else g->right = t;
+}
+/*-------------------------------------------------------*/
+static void treapInsert(TreapNode **root, TreapNode *t, TreapNode *parent, int left)
+{
+/* Hang t below parent (as its left child if left), or make it the root if
+ * parent is NULL, then restore the heap order. */
+    t->left = t->right = NULL;
+    t->parent = parent;
+    if (!parent) *root = t;
+    else if (left) parent->left = t;
+    else parent->right = t;
+    while (t->parent && t->parent->prio < t->prio) rotateUp(root, t);
+}
+/*-------------------------------------------------------*/
+static void treapRemove(TreapNode **root, TreapNode *t)
+{
+    TreapNode *child;
+
+    while (t->left || t->right) {
+        child = (!t->right || (t->left && t->left->prio > t->right->prio))? t->left: t->right;
+        rotateUp(root, child);
+    }
+    if (!t->parent) *root = NULL;
+    else if (t->parent->left == t) t->parent->left = NULL;
+    else t->parent->right = NULL;
+}
+/*-------------------------------------------------------*/
+static TreapNode *treapNext(TreapNode *t)
+{
+/* In-order successor of t, or NULL */
+    if (t->right) {
+        for (t = t->right; t->left; t = t->left) {}
+        return t;
+    }
+    while (t->parent && t->parent->right == t) t = t->parent;
+    return t->parent;
+}
+/*-------------------------------------------------------*/
+static TreapNode *treapPrev(TreapNode *t)
+{
+/* In-order predecessor of t, or NULL */
+    if (t->left) {
+        for (t = t->left; t->right; t = t->right) {}
+        return t;
+    }
+    while (t->parent && t->parent->left == t) t = t->parent;
+    return t->parent;
+}
+/*-------------------------------------------------------*/
+static CoordKey coordKey(Coord f)
+{
+/* Unsigned integer in the same order as f (-0 same as 0) */
+#ifdef FIXED_COORDS
+    return (unsigned)f ^ 0x80000000u;
+#else
+    CoordKey u, sign = (CoordKey)1 << (8*sizeof(u) - 1);
+
+    f += (Coord)0;
+    memcpy(&u, &f, sizeof(u));
+    return (u & sign)? ~u: u | sign;
+#endif
+}
+/*-------------------------------------------------------*/
+static unsigned long long doubleKey(double d)
+{
+/* Unsigned integer in the same order as d (-0 same as 0) */
+    unsigned long long u, sign = 1ULL << 63;
+
+    d += 0.0;
+    memcpy(&u, &d, sizeof(u));
+    return (u & sign)? ~u: u | sign;
+}
+/*-------------------------------------------------------*/
+static void setKey(JoinKey *k, CoordKey hi, CoordKey lo, int node)
+{
+/* Make k sort node by hi, then by lo */
+#ifdef DOUBLE_COORDS
+    k->key = hi;
+    k->low = lo;
+#else
+    k->key = ((unsigned long long)hi << 32) | lo;
+#endif
+    k->node = node;
+}
+/*-------------------------------------------------------*/
+static JoinKey *radixSort(JoinKey *keys, JoinKey *tmp, int n)
+{
+/* Stable LSD radix sort of keys[0 .. n-1], a byte at a time, using tmp
+ * for scratch. Bytes that are the same in all keys are skipped.
+ * Returns whichever of keys and tmp holds the result. */
+    int count[KEY_BYTES][256], i, b, sum, c;
+    JoinKey *t;
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+        for (b = 0; b < KEY_BYTES; b++) count[b][KEY_BYTE(keys[i], b)]++;
+
+    for (b = 0; b < KEY_BYTES; b++) {
+        if (count[b][KEY_BYTE(keys[0], b)] == n) continue;
+        for (sum = 0, c = 0; c < 256; c++) {
+            i = count[b][c];
+            count[b][c] = sum;
+            sum += i;
+        }
+        for (i = 0; i < n; i++) tmp[count[b][KEY_BYTE(keys[i], b)]++] = keys[i];
+        t = keys;
+        keys = tmp;
+        tmp = t;
+    }
+    return keys;
+}
+/*-------------------------------------------------------*/
+static JoinKey *sortKeys(JoinKey *keys, JoinKey *tmp, int n)
+{
+/* Sort keys[0 .. n-1] by key, using tmp (n keys) for scratch.
+ * Returns whichever of keys and tmp holds the result. */
+    JoinKey k;
+    int i, j;
+
+    if (n >= 128) return radixSort(keys, tmp, n);
+    for (i = 1; i < n; i++) { /* insertion sort */
+        k = keys[i];
+        for (j = i; j > 0 && KEY_LESS(k, keys[j-1]); j--) keys[j] = keys[j-1];
+        keys[j] = k;
+    }
+    return keys;
+}
+/*-------------------------------------------------------*/
+static int compareLow(const void *pp, const void *qq)
+{
+    Coord p = (*(TreapNode**)pp)->y, q = (*(TreapNode**)qq)->y;
+    return (p > q) - (p < q);
+}
+/*-------------------------------------------------------*/
+static int compareHigh(const void *pp, const void *qq)
+{
+    Coord p = (*(TreapNode**)pp)->top, q = (*(TreapNode**)qq)->top;
+    return (p > q) - (p < q);
+}
+/*-------------------------------------------------------*/
+static void climbChain(FillContext *fc, TreapNode *t, Coord y)
+{
+/* Move the current edge of up-chain t up to the one spanning y, or to
+ * its last edge if y is at its top */
+    NodeRef e;
+
+    while (Y(t->node) <= y && DELTAY(t->node) > 0) {
+        e = t->node;
+        t->node = NEXT(e);
+        t->x = X(e);
+        t->y = Y(e);
+        t->slope = (Real)(X(NEXT(e)) - X(e))/DELTAY(e);
+        t->edge = VERTEX_INDEX(e);
+    }
+}
+/*-------------------------------------------------------*/
+static int findRayHits(FillContext *fc, int n, int numbLoops, int numbQueries, int tops)
+{
+/*----------------------------------------------
+ * For every node q in fc->splitJoins[0 .. numbQueries-1], sorted by y,
+ * find the up-edge hit first by a ray going left from q, and store the
+ * index of its lower vertex in fc->rayHits[VERTEX_INDEX(q)] (-1 if there
+ * is none). n is the number of nodes of the vertex loops, which start at
+ * fc->rings[0 .. numbLoops-1].
+ *
+ * This is a sweep upward over the vertex loops, keeping the up-chains
+ * crossing the sweep line in a treap ordered by x. Each chain is inserted
+ * at its lower and removed at its upper vertex (so a chain spans
+ * lower <= y < upper, or lower <= y <= upper if tops is set, when a ray
+ * at the height of its upper vertex hits its last edge there), and its
+ * current edge is moved up as the sweep line passes its vertices. Chains
+ * that span the y of no query are left out.
+ *
+ * Returns -1 if out of memory.
+ */
+    int i, numbChains = 0, ins, del, qi, lo, hi, left = 0;
+    NodeRef c, e, q, *queries = fc->splitJoins;
+    TreapNode *root = NULL, *t, *parent, *hit, **insChains, **delChains;
+
+    if (growBuffer((void**)&fc->sweepChains, &fc->maxSweep, n, n, sizeof(TreapNode*)) ||
+        growBuffer((void**)&fc->treapNodes, &fc->maxTreap, n, n, sizeof(TreapNode)) ||
+        growBuffer((void**)&fc->rayHits, &fc->maxRayHits, n, n, sizeof(int)))
+        return -1;
+
+    /* collect the up-chains spanning the y of a query */
+    insChains = fc->sweepChains;
+    delChains = insChains + n/2; /* each chain is preceded by an edge that is not up */
+    for (i = 0; i < numbLoops; i++) {
+        e = c = fc->rings[i];
+        do {
+            if ((DELTAY(e) > 0) && (DELTAY(PREV(e)) <= 0)) {
+                for (q = NEXT(e); DELTAY(q) > 0; q = NEXT(q)) {}
+
+                /* first query at or above the chain */
+                for (lo = 0, hi = numbQueries; lo < hi; ) {
+                    qi = (lo + hi) / 2;
+                    if (Y(queries[qi]) < Y(e)) lo = qi + 1;
+                    else hi = qi;
+                }
+                if ((lo < numbQueries) && (Y(queries[lo]) < Y(q) || (tops && Y(queries[lo]) == Y(q)))) {
+                    t = fc->treapNodes + VERTEX_INDEX(e);
+                    t->node = NEXT(e);
+                    t->x = X(e);
+                    t->y = Y(e);
+                    t->slope = (Real)(X(NEXT(e)) - X(e))/DELTAY(e);
+                    t->edge = VERTEX_INDEX(e);
+                    t->top = Y(q);
+                    t->prio = treapPriority((unsigned)t->edge);
+                    insChains[numbChains] = delChains[numbChains] = t;
+                    numbChains++;
+                }
+            }
+            e = NEXT(e);
+        } while (e != c);
+    }
+    qsort((void*)insChains, (size_t)numbChains, sizeof(TreapNode*), compareLow);
+    qsort((void*)delChains, (size_t)numbChains, sizeof(TreapNode*), compareHigh);
+
+    for (ins = del = qi = 0; qi < numbQueries; qi++) {
+        q = queries[qi];
+
+        /* advance the sweep line to q->y; at equal y, remove before insert */
+        for (;;) {
+            if ((del < numbChains) && (delChains[del]->top < Y(q) || (!tops && delChains[del]->top == Y(q))) &&
+                    !((ins < numbChains) && (insChains[ins]->y < delChains[del]->top))) {
+                treapRemove(&root, delChains[del++]);
+
+            } else if ((ins < numbChains) && (insChains[ins]->y <= Y(q))) {
+                t = insChains[ins++];
+                for (parent = NULL, hit = root; hit; ) {
+                    parent = hit;
+                    climbChain(fc, hit, t->y);
+                    left = t->x < XAT(hit, t->y);
+                    hit = left? hit->left: hit->right;
+                }
+                treapInsert(&root, t, parent, left);
+            } else break;
+        }
+
+        /* rightmost edge left of q */
+        for (hit = NULL, t = root; t; ) {
+            climbChain(fc, t, Y(q));
+            if (XAT(t, Y(q)) < X(q)) {
+                hit = t;
+                t = t->right;
+            } else t = t->left;
+        }
+        fc->rayHits[VERTEX_INDEX(q)] = hit? hit->edge: -1;
+    }
+    return 0;
+}
+/*-------------------------------------------------------*/
+static int findSplitHits(FillContext *fc, int n, int numbLoops, int numJoins)
+{
+/* Find the window edge on the left of each join that splits a window
+ * (see findRayHits), before any joins are processed.
+ * Returns the number of split joins, or -1 if out of memory. */
+    int i, qi, numbSplits = 0;
+    JoinKey *keys;
+
+    for (i = 0; i < numJoins; i++)
+        if (IS_SPLIT(JOINTYPE(fc->sortedJoins[i]))) numbSplits++;
+    if (!numbSplits) return 0;
+
+    if (growBuffer((void**)&fc->splitJoins, &fc->maxSplits, numbSplits, numbSplits, sizeof(NodeRef)) ||
+        growBuffer((void**)&fc->treapNodes, &fc->maxTreap, n + 2*numJoins, n + 2*numJoins, sizeof(TreapNode)) ||
+        growBuffer((void**)&fc->addedEdges, &fc->maxAddedEdges, 3*numJoins, 3*numJoins, sizeof(int)))
+        return -1;
+
+    /* sort the split joins by y (the join keys are free again) */
+    keys = fc->joinKeys;
+    for (i = 0, qi = 0; i < numJoins; i++)
+        if (IS_SPLIT(JOINTYPE(fc->sortedJoins[i]))) {
+            setKey(&keys[qi++], coordKey(Y(fc->sortedJoins[i])), 0, VERTEX_INDEX(fc->sortedJoins[i]));
+        }
+    keys = sortKeys(keys, keys + numbSplits, numbSplits);
+    for (qi = 0; qi < numbSplits; qi++) fc->splitJoins[qi] = VERTEX(keys[qi].node);
+
+    return findRayHits(fc, n, numbLoops, numbSplits, 0)? -1: numbSplits;
+}
+/*-------------------------------------------------------*/
+static NodeRef findPiece(FillContext *fc, TreapNode *root, int edge, Coord y)
+{
+/* Node starting the piece of the given edge that spans y. The pieces are
+ * the parts an edge has been cut into by the joins processed so far;
+ * only the ones not starting at the edge's own lower vertex are in the treap. */
+    TreapNode *t, *hit = NULL;
+
+    USES_NODES(fc);
+    for (t = root; t; ) {
+        if (t->edge < edge || (t->edge == edge && t->y <= y)) {
+            hit = t;
+            t = t->right;
+        } else t = t->left;
+    }
+    return (hit && hit->edge == edge)? hit->node: VERTEX(edge);
+}
+/*-------------------------------------------------------*/
+static void addPiece(FillContext *fc, TreapNode **root, TreapNode *t, NodeRef p, int edge)
+{
+/* Record that p starts a new piece of edge (after any piece starting at the same y). */
+    TreapNode *parent, *s;
+    int left = 0;
+
+    t->node = p;
+    t->y = Y(p);
+    t->edge = edge;
+    t->prio = treapPriority((unsigned)(t - fc->treapNodes));
+    for (parent = NULL, s = *root; s; ) {
+        parent = s;
+        left = edge < s->edge || (edge == s->edge && Y(p) < s->y);
+        s = left? s->left: s->right;
+    }
+    treapInsert(root, t, parent, left);
+}
+/*-------------------------------------------------------*/
+static int sortJoins(FillContext *fc, int numbLoops, int numJoins)
+{
+/* Put the joins, linked by nextJoin in a cycle from each of
+ * fc->rings[0 .. numbLoops-1], into fc->sortedJoins by increasing x,
+ * joins at the same x by decreasing y. Returns -1 if out of memory. */
+    JoinKey *keys;
+    NodeRef q;
+    int i = 0, k;
+
+    if (growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 2*numJoins, 2*numJoins, sizeof(JoinKey)))
+        return -1;
+    keys = fc->joinKeys;
+
+    /* ties are done in decreasing y value */
+    for (k = 0; k < numbLoops; k++) {
+        q = fc->rings[k];
+        do {
+            setKey(&keys[i++], coordKey(X(q)), ~coordKey(Y(q)), VERTEX_INDEX(q));
+            q = NEXTJOIN(q);
+        } while (q != fc->rings[k]);
+    }
+    keys = sortKeys(keys, keys + numJoins, numJoins);
+
+    for (i = 0; i < numJoins; i++) fc->sortedJoins[i] = VERTEX(keys[i].node);
+    return 0;
+}
+/*-------------------------------------------------------*/
+static Coord edgeX(FillContext *fc, NodeRef p, Coord y)
+{
+/* x of the edge starting at p at height y, rounded to the nearest
+ * fixed-point value with FIXED_COORDS */
+    USES_NODES(fc);
+#ifdef FIXED_COORDS
+    long long num = (long long)(X(NEXT(p)) - X(p)) * (y - Y(p)), d = DELTAY(p);
+
+    if (d < 0) {
+        num = -num;
+        d = -d;
+    }
+    return X(p) + (Coord)((num >= 0? num + d/2: num - d/2) / d);
+#else
+    return X(p) + (X(NEXT(p)) - X(p))/DELTAY(p) * (y - Y(p));
+#endif
+}
+/*-------------------------------------------------------*/
+static int linkHoles(FillContext *fc, int n, int numbLoops, int numbHoles)
+{
+/*----------------------------------------------
+ * Link each hole into the loop around it. The vertex loops start at
+ * fc->rings[0 .. numbLoops+numbHoles-1], the holes last, each at its top
+ * vertex t. A ray going left from t first hits an up-edge of the loop
+ * around the hole; the horizontal cut from t to the point hit joins the
+ * two loops into one:
+ *
+ *     ... e -> a -> t -> (hole) -> t' -> a' -> NEXT(e) ...
+ *
+ * where e starts the piece of the edge hit that spans t, and a, a', t'
+ * are the nodes n+3*j .. n+3*j+2. This is the cut that processing t as
+ * a split join would make. If the ray hits the lower vertex of the edge,
+ * the cut starts at that vertex instead of at a new node a, at the right
+ * end of any horizontal edges coming into it; if it hits the upper
+ * vertex, as at a peak or the top of another hole at the height of t, at
+ * that vertex, at the right end of any horizontal edges going out of it
+ * (a cut through the vertex would touch it). Holes inside no loop are
+ * left out. Returns -1 if out of memory.
+ */
+    int i, j, edge, prevEdge = -1;
+    JoinKey *keys;
+    NodeRef t, e = NIL, a, a_out, t_out;
+
+    if (growBuffer((void**)&fc->splitJoins, &fc->maxSplits, numbHoles, numbHoles, sizeof(NodeRef)) ||
+        growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 2*numbHoles, 2*numbHoles, sizeof(JoinKey)))
+        return -1;
+    if (fc->triangulate &&
+        (growBuffer((void**)&fc->bridgeVertex, &fc->maxBridgeVertex, 3*numbHoles, 3*numbHoles, sizeof(int)) ||
+         growBuffer((void**)&fc->addedPoints, &fc->maxAddedPoints, fc->numbAddedPoints + numbHoles,
+                    numbHoles, sizeof(Point))))
+        return -1;
+
+    /* find the edge hit from the top of each hole, the holes by y, then x */
+    keys = fc->joinKeys;
+    for (i = 0; i < numbHoles; i++) {
+        t = fc->rings[numbLoops + i];
+        setKey(&keys[i], coordKey(Y(t)), coordKey(X(t)), VERTEX_INDEX(t));
+    }
+    keys = sortKeys(keys, keys + numbHoles, numbHoles);
+    for (i = 0; i < numbHoles; i++) fc->splitJoins[i] = VERTEX(keys[i].node);
+    if (findRayHits(fc, n, numbLoops + numbHoles, numbHoles, 1)) return -1;
+
+    /* cut the pieces of each edge from the bottom up, tops at the same
+     * height from left to right (the sort is stable) */
+    keys = fc->joinKeys;
+    for (i = 0, j = 0; i < numbHoles; i++) {
+        t = fc->splitJoins[i];
+        if (fc->rayHits[VERTEX_INDEX(t)] < 0) continue;
+        setKey(&keys[j++], (CoordKey)fc->rayHits[VERTEX_INDEX(t)], coordKey(Y(t)), VERTEX_INDEX(t));
+    }
+    keys = sortKeys(keys, keys + j, j);
+
+    for (i = 0; i < j; i++) {
+        t = VERTEX(keys[i].node);
+        edge = fc->rayHits[keys[i].node];
+        a_out = VERTEX(n + 3*i + 1);
+        t_out = VERTEX(n + 3*i + 2);
+
+        if (edge != prevEdge) e = VERTEX(edge); /* else e starts the piece above the last cut */
+        if (Y(t) == Y(e)) {
+            a = e; /* the ray ends at the lower vertex of the edge */
+            while (DELTAY(PREV(a)) == (Coord)0 && X(PREV(a)) > X(a) && X(PREV(a)) < X(t)) a = PREV(a);
+        } else if (Y(t) == Y(NEXT(e))) {
+            a = NEXT(e); /* or at the upper one */
+            while (DELTAY(a) == (Coord)0 && X(NEXT(a)) > X(a) && X(NEXT(a)) < X(t)) a = NEXT(a);
+        } else {
+            a = VERTEX(n + 3*i);
+            X(a) = edgeX(fc, e, Y(t));
+            Y(a) = Y(t);
+            PREVJOIN(a) = NIL;
+            if (fc->triangulate) {
+                fc->bridgeVertex[3*i] = fc->bridgeVertex[3*i+1] = n + fc->numbAddedPoints;
+                fc->addedPoints[fc->numbAddedPoints].x = X(a);
+                fc->addedPoints[fc->numbAddedPoints++].y = Y(a);
+            }
+            NEXT(a) = NEXT(e);
+            PREV(NEXT(e)) = a;
+            NEXT(e) = a;
+            PREV(a) = e;
+            DELTAY(e) = Y(a) - Y(e);
+            e = a;
+        }
+        if (a != VERTEX(n + 3*i) && fc->triangulate)
+            fc->bridgeVertex[3*i+1] = (VERTEX_INDEX(a) < n)? VERTEX_INDEX(a):
+                                      fc->bridgeVertex[VERTEX_INDEX(a) - n];
+        prevEdge = edge;
+
+        X(a_out) = X(a);
+        X(t_out) = X(t);
+        Y(a_out) = Y(t_out) = Y(t);
+        PREVJOIN(a_out) = PREVJOIN(t_out) = NIL;
+        if (fc->triangulate) fc->bridgeVertex[3*i+2] = VERTEX_INDEX(t);
+
+        NEXT(a_out) = NEXT(a);
+        PREV(NEXT(a)) = a_out;
+        DELTAY(a_out) = Y(NEXT(a_out)) - Y(a_out);
+        NEXT(PREV(t)) = t_out;
+        PREV(t_out) = PREV(t);
+        NEXT(t_out) = a_out;
+        PREV(a_out) = t_out;
+        DELTAY(t_out) = (Coord)0;
+        NEXT(a) = t;
+        PREV(t) = a;
+        DELTAY(a) = (Coord)0;
+        if (a == e) e = a_out;
+    }
+    return 0;
+}
+/*-------------------------------------------------------*/
+static NodeRef topVertex(FillContext *fc, NodeRef c)
+{
+/* Top (leftmost) vertex of the vertex loop at c */
+    NodeRef p, q;
+
+    USES_NODES(fc);
+    for (p = c, q = NEXT(c); q != c; q = NEXT(q))
+        if (Y(q) > Y(p) || (Y(q) == Y(p) && X(q) < X(p))) p = q;
+    return p;
+}
+/*-------------------------------------------------------*/
+static void linkNodes(FillContext *fc, NodeRef p, NodeRef q)
+{
+/* Make q follow p in their vertex loop */
+    USES_NODES(fc);
+    NEXT(p) = q;
+    PREV(q) = p;
+    DELTAY(p) = Y(q) - Y(p);
+}
+/*-------------------------------------------------------*/
+static NodeRef removeRepeats(FillContext *fc, NodeRef c)
+{
+/*----------------------------------------------
+ * Remove the zero-length edges and the spikes (an edge followed by its
+ * reverse) of the vertex loop at c. The loop is reduced like a stack in
+ * one pass from c, then at the seam between its last node and c.
+ * Returns a node of what is left, or NIL if that is less than a triangle.
+ */
+    NodeRef p = c, q, r;
+    int numb = 1;
+
+    for (q = NEXT(c); q != c; q = r) {
+        r = NEXT(q);
+        if (SAME_POINT(q, p)) linkNodes(fc, p, r);
+        else if (numb > 1 && SAME_POINT(q, PREV(p))) {
+            p = PREV(p);
+            numb--;
+            linkNodes(fc, p, r);
+        } else {
+            p = q;
+            numb++;
+        }
+    }
+    while (numb >= 3) {
+        if (SAME_POINT(p, c)) {
+            p = PREV(p);
+            numb--;
+        } else if (SAME_POINT(PREV(p), c)) {
+            p = PREV(PREV(p));
+            numb -= 2;
+        } else if (SAME_POINT(p, NEXT(c))) {
+            c = NEXT(NEXT(c));
+            numb -= 2;
+        } else break;
+        linkNodes(fc, p, c);
+    }
+    return (numb >= 3)? c: NIL;
+}
+/*-------------------------------------------------------*/
+static void reverseLoop(FillContext *fc, NodeRef c)
+{
+/* Reverse the direction of the vertex loop at c */
+    NodeRef p = c, q;
+
+    USES_NODES(fc);
+    do {
+        q = NEXT(p);
+        NEXT(p) = PREV(p);
+        PREV(p) = q;
+        p = q;
+    } while (p != c);
+    do {
+        DELTAY(p) = Y(NEXT(p)) - Y(p);
+        p = NEXT(p);
+    } while (p != c);
+}
+/*-------------------------------------------------------*/
+static double orient(FillContext *fc, NodeRef a, NodeRef b, NodeRef c)
+{
+/* Twice the area of triangle abc, > 0 if counterclockwise. Only its
+ * sign is exact with FIXED_COORDS. */
+    USES_NODES(fc);
+#ifdef FIXED_COORDS
+    return (double)((long long)(X(b) - X(a)) * (Y(c) - Y(a))
+                    - (long long)(Y(b) - Y(a)) * (X(c) - X(a)));
+#else
+    return ((double)X(b) - X(a)) * ((double)Y(c) - Y(a))
+           - ((double)Y(b) - Y(a)) * ((double)X(c) - X(a));
+#endif
+}
+/*-------------------------------------------------------*/
+static int edgesMeet(FillContext *fc, NodeRef a, NodeRef c)
+{
+/* Edges a -> NEXT(a) and c -> NEXT(c) cross or touch, other than at the
+ * vertex they share if they are consecutive and do not fold back */
+    NodeRef b = NEXT(a), d = NEXT(c), t;
+    double o1, o2, o3, o4;
+
+    if (d == a) {
+        t = a;
+        a = c;
+        c = t;
+        b = NEXT(a);
+        d = NEXT(c);
+    }
+    if (b == c)
+        return orient(fc, a, b, d) == 0 &&
+               ((double)X(b) - X(a)) * ((double)X(d) - X(b)) +
+               ((double)Y(b) - Y(a)) * ((double)Y(d) - Y(b)) < 0;
+    o1 = orient(fc, a, b, c);
+    o2 = orient(fc, a, b, d);
+    if ((o1 > 0 && o2 > 0) || (o1 < 0 && o2 < 0)) return 0;
+    o3 = orient(fc, c, d, a);
+    o4 = orient(fc, c, d, b);
+    if ((o3 > 0 && o4 > 0) || (o3 < 0 && o4 < 0)) return 0;
+    if (o1 != 0 || o2 != 0 || o3 != 0 || o4 != 0) return 1;
+
+    /* on one line: they meet unless one ends before the other starts */
+    if (ABOVE(a, b)) {
+        t = a;
+        a = b;
+        b = t;
+    }
+    if (ABOVE(c, d)) {
+        t = c;
+        c = d;
+        d = t;
+    }
+    return !(ABOVE(c, b) || ABOVE(a, d));
+}
+/*-------------------------------------------------------*/
+static int cleanRings(FillContext *fc, int n, int *numbLoops, int *numbHoles, int reorient)
+{
+/*----------------------------------------------
+ * Check the vertex loops fc->rings[0 .. *numbLoops + *numbHoles - 1]
+ * (outer loops, then holes at their top vertex) and, if reorient is set,
+ * orient them by how deeply they are nested, then sort them into outer
+ * loops and holes again.
+ *
+ * This is a sweep upward (by y, then x) over all vertices, keeping the
+ * edges crossing the sweep line in a treap ordered by x. As in the
+ * Shamos-Hoey test, each edge is checked against its neighbours whenever
+ * they change, which finds a pair of edges that cross or touch if there
+ * is one. The edge left of the lowest vertex of a loop gives its depth:
+ * one more than the depth of that edge's loop if its inside is right of
+ * the edge, else the same. Loops at even depth are made clockwise, the
+ * others counterclockwise.
+ *
+ * Returns -1 if out of memory, -2 if edges cross or touch.
+ */
+    int i, j, k, m = 0, left = 0, numbRings = *numbLoops + *numbHoles,
+        *ring, *depth;
+    JoinKey *keys;
+    NodeRef c, p, e, lo, hi, edges[2];
+    TreapNode *root = NULL, *t, *s, *parent, *l, *r;
+    double o;
+
+    if (growBuffer((void**)&fc->ringInfo, &fc->maxRingInfo, n + numbRings, n + numbRings, sizeof(int)) ||
+        growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 2*n, 2*n, sizeof(JoinKey)) ||
+        growBuffer((void**)&fc->treapNodes, &fc->maxTreap, n, n, sizeof(TreapNode)) ||
+        growBuffer((void**)&fc->splitJoins, &fc->maxSplits, numbRings, numbRings, sizeof(NodeRef)))
+        return -1;
+    ring = fc->ringInfo;
+    depth = ring + n;
+
+    /* the vertices by y, then x */
+    keys = fc->joinKeys;
+    for (k = 0; k < numbRings; k++) {
+        depth[k] = -1;
+        p = c = fc->rings[k];
+        do {
+            ring[VERTEX_INDEX(p)] = k;
+            t = fc->treapNodes + VERTEX_INDEX(p);
+            t->node = p;
+            t->prio = treapPriority((unsigned)VERTEX_INDEX(p));
+            setKey(&keys[m++], coordKey(Y(p)), coordKey(X(p)), VERTEX_INDEX(p));
+            p = NEXT(p);
+        } while (p != c);
+    }
+    keys = sortKeys(keys, keys + m, m);
+
+    for (i = 0; i < m; i++) {
+        p = VERTEX(keys[i].node);
+        if (i > 0 && SAME_POINT(p, VERTEX(keys[i-1].node))) return -2; /* loops touch at a vertex */
+        edges[0] = PREV(p);
+        edges[1] = p;
+
+        /* remove the edges ending at p, then check the two that meet */
+        for (j = 0; j < 2; j++) {
+            e = edges[j];
+            if (!ABOVE(p, (e == p)? NEXT(p): e)) continue;
+            t = fc->treapNodes + VERTEX_INDEX(e);
+            l = treapPrev(t);
+            r = treapNext(t);
+            treapRemove(&root, t);
+            if (l && r && edgesMeet(fc, l->node, r->node)) return -2;
+        }
+
+        /* depth of the loop of its lowest vertex, from the edge left of it */
+        k = ring[VERTEX_INDEX(p)];
+        if (depth[k] < 0) {
+            for (l = NULL, s = root; s; ) {
+                e = s->node;
+                lo = ABOVE(NEXT(e), e)? e: NEXT(e);
+                hi = (lo == e)? NEXT(e): e;
+                o = orient(fc, lo, hi, p);
+                if (o == 0) return -2;
+                if (o > 0) s = s->left;
+                else {
+                    l = s;
+                    s = s->right;
+                }
+            }
+            if (!l) depth[k] = 0;
+            else {
+                e = l->node;
+                j = ring[VERTEX_INDEX(e)];
+                depth[k] = depth[j] + ((j < *numbLoops) == ABOVE(NEXT(e), e));
+            }
+        }
+
+        /* insert the edges starting at p, and check them against their neighbours */
+        for (j = 0; j < 2; j++) {
+            e = edges[j];
+            hi = (e == p)? NEXT(p): e;
+            if (!ABOVE(hi, p)) continue;
+            t = fc->treapNodes + VERTEX_INDEX(e);
+            for (parent = NULL, s = root; s; ) {
+                parent = s;
+                c = s->node;
+                lo = ABOVE(NEXT(c), c)? c: NEXT(c);
+                if (lo == p) o = orient(fc, p, (lo == c)? NEXT(c): c, hi);
+                else if ((o = orient(fc, lo, (lo == c)? NEXT(c): c, p)) == 0)
+                    return -2;
+                left = o > 0;
+                s = left? s->left: s->right;
+            }
+            treapInsert(&root, t, parent, left);
+            if ((l = treapPrev(t)) && edgesMeet(fc, l->node, e)) return -2;
+            if ((r = treapNext(t)) && edgesMeet(fc, r->node, e)) return -2;
+        }
+    }
+
+    /* orient the loops; the outer ones stay in front, the holes go after them */
+    for (k = 0, i = 0, j = 0; reorient && k < numbRings; k++) {
+        c = fc->rings[k];
+        if ((k < *numbLoops) != !(depth[k] & 1)) reverseLoop(fc, c);
+        if (depth[k] & 1) fc->splitJoins[j++] = topVertex(fc, c);
+        else fc->rings[i++] = c;
+    }
+    if (!reorient) return 0;
+    memcpy(fc->rings + i, fc->splitJoins, j * sizeof(NodeRef));
+    *numbLoops = i;
+    *numbHoles = j;
+    return 0;
+}
+/*-------------------------------------------------------*/
+static int ringOf(const int ringOffsets[], int numbRings, int i)
+{
+/* Ring of vertex i */
+    int lo, hi, mid;
+
+    for (lo = 0, hi = numbRings - 1; lo < hi; ) {
+        mid = (lo + hi + 1)/2;
+        if (ringOffsets[mid] <= i) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+/*-------------------------------------------------------*/
+static Coord spanX(const FillEdge *e, Coord y)
+{
+/* x of edge e at height y, exact at its ends (see edgeX) */
+#ifdef FIXED_COORDS
+    long long num = (long long)(e->xt - e->xb) * (y - e->yb), d = e->yt - e->yb;
+
+    return e->xb + (Coord)((num >= 0? num + d/2: num - d/2) / d);
+#else
+    if (y == e->yt) return e->xt;
+    return e->xb + e->slope * (y - e->yb);
+#endif
+}
+/*-------------------------------------------------------*/
+static Coord toCoord(double c)
+{
+/* c rounded to a coordinate */
+#ifdef FIXED_COORDS
+    c = floor(c + .5);
+#endif
+    return (Coord)c;
+}
+/*-------------------------------------------------------*/
+static int addPoint(FillContext *fc, int n, Coord x, Coord y)
+{
+/* Append (x, y) to fc->addedPoints. Returns its vertex index (n on), or
+ * -1 if out of memory. */
+    if (growBuffer((void**)&fc->addedPoints, &fc->maxAddedPoints, fc->numbAddedPoints + 1,
+                   NUMB_WS, sizeof(Point)))
+        return -1;
+    fc->addedPoints[fc->numbAddedPoints].x = x;
+    fc->addedPoints[fc->numbAddedPoints].y = y;
+    return n + fc->numbAddedPoints++;
+}
+/*-------------------------------------------------------*/
+static int triangulateTrapezoids(FillContext *fc, int t, int n)
+{
+/* Append the triangles of the trapezoids that continue each other from
+ * fc->trapezoids[t] down to fc->triangles, two per trapezoid, or one if
+ * it ends in a point. The corners are added points, shared where the
+ * trapezoids meet. Returns -1 if out of memory. */
+    Trapezoid *u = fc->trapezoids + t;
+    int tl, tr, bl, br, *tri;
+
+    tl = addPoint(fc, n, u->xlt, u->yt);
+    tr = (u->xrt == u->xlt)? tl: addPoint(fc, n, u->xrt, u->yt);
+    for (;;) {
+        bl = addPoint(fc, n, u->xlb, u->yb);
+        br = (u->xrb == u->xlb)? bl: addPoint(fc, n, u->xrb, u->yb);
+        if (tl < 0 || tr < 0 || bl < 0 || br < 0 ||
+            growBuffer((void**)&fc->triangles, &fc->maxTriangles, 3*(fc->numbTriangles + 2),
+                       3*NUMB_WS, sizeof(int)))
+            return -1;
+        if (tr != tl) {
+            tri = fc->triangles + 3*fc->numbTriangles++;
+            tri[0] = tl;
+            tri[1] = tr;
+            tri[2] = br;
+        }
+        if (br != bl) {
+            tri = fc->triangles + 3*fc->numbTriangles++;
+            tri[0] = tl;
+            tri[1] = br;
+            tri[2] = bl;
+        }
+        if (u->below < 0) return 0;
+        u = fc->trapezoids + u->below;
+        tl = bl;
+        tr = br;
+    }
+}
+/*-------------------------------------------------------*/
+static int makeTrapezoidSequence(FillContext *fc, int t)
+{
+/* Append the wedge sequence of the trapezoids that continue each other
+ * from fc->trapezoids[t] down to the output of fc, or pass it to
+ * fc->sink. A wedge element starts where an edge of the trapezoids
+ * changes, corrected to the corner there: a side that starts at a
+ * rounded crossing is off its edge, and would stay off by the rounding
+ * times the slope after it. Returns -1 if out of memory or the sink
+ * stopped. */
+    Trapezoid *traps = fc->trapezoids, *u;
+    FillEdge *edges = fc->fillEdges;
+    Coord bb_xmin = traps[t].xlt, bb_xmax = traps[t].xrt; /* bounding box for wedge sequence */
+    Coord top = traps[t].yt; /* of the current wedge element */
+    double xl = traps[t].xlt, xr = traps[t].xrt; /* the sides as read from the wedges */
+    int i, numbWe = 1;
+    WedgeSequence *s;
+    WedgeElement *we;
+
+    for (u = traps + t; ; u = traps + u->below) {
+        if (u->xlb < bb_xmin) bb_xmin = u->xlb;
+        if (u->xrb > bb_xmax) bb_xmax = u->xrb;
+        if (u->below < 0) break;
+        if (traps[u->below].left != u->left || traps[u->below].right != u->right) numbWe++;
+    }
+
+    /* room for this sequence, the END opcode and its wedges */
+    if (reserveWedges(fc, fc->numbWs + 2, fc->numbWe + numbWe)) return -1;
+    s = fc->ws + fc->numbWs;
+    we = fc->we + fc->numbWe;
+
+    s->opcode = WEDGE_SEQ;
+    s->x = bb_xmin;
+    s->y = traps[t].yt;
+    s->pwidth = bb_xmax - bb_xmin;
+    u = traps + t;
+    we[0].wedgeType = BOTH;
+    we[0].lCorr = u->xlt - bb_xmin;
+    we[0].rCorr = u->xrt - bb_xmin;
+    we[0].lSlope = edges[u->left].slope;
+    we[0].rSlope = edges[u->right].slope;
+    for (i = 0; ; u = traps + u->below) {
+        we[i].height = top - u->yb;
+        if (u->below < 0) break;
+        if (traps[u->below].left == u->left && traps[u->below].right == u->right) continue;
+        xl -= we[i].lSlope * we[i].height;
+        xr -= we[i].rSlope * we[i].height;
+        i++;
+        top = u->yb;
+        we[i].wedgeType = (traps[u->below].left == u->left)? RIGHT:
+                          (traps[u->below].right == u->right)? LEFT: BOTH;
+        we[i].lCorr = we[i].rCorr = (Coord)0;
+        if (we[i].wedgeType != RIGHT) xl += (we[i].lCorr = toCoord(traps[u->below].xlt - xl));
+        if (we[i].wedgeType != LEFT) xr += (we[i].rCorr = toCoord(traps[u->below].xrt - xr));
+        we[i].lSlope = edges[traps[u->below].left].slope;
+        we[i].rSlope = edges[traps[u->below].right].slope;
+    }
+    s->pht = traps[t].yt - u->yb;
+    we[i].wedgeType = (WedgeType) (we[i].wedgeType | LAST_WE);
+
+    s->firstWe = fc->numbWe;
+    s->numbWe = numbWe;
+#ifdef FILL_STATS
+    fc->stats.wedges += numbWe;
+    if (numbWe > fc->stats.maxWedges) fc->stats.maxWedges = numbWe;
+#endif
+    if (fc->sink) {
+        fc->numbSunk++;
+        return fc->sink(fc->sinkData, s, we)? -1: 0;
+    }
+    fc->numbWe += numbWe;
+    fc->numbWs++;
+    return 0;
+}
+/*-------------------------------------------------------*/
+static double edgeAt(const FillEdge *e, Coord y)
+{
+/* x of edge e at height y, unrounded */
+    return e->xb + ((double)e->xt - e->xb) * ((double)y - e->yb) / ((double)e->yt - e->yb);
+}
+/*-------------------------------------------------------*/
+static int startsLeftOf(const FillEdge *e, int ei, const FillEdge *f, int fi, Coord y)
+{
+/* Edge e (index ei), which starts at y, is left of edge f (index fi)
+ * just below y: by x at y, then by the way they go down, then by index */
+    double xf = edgeAt(f, y), d;
+
+    if (e->xt != xf) return e->xt < xf;
+    d = ((double)e->xb - e->xt) * ((double)f->yt - f->yb) - ((double)f->xb - f->xt) * ((double)e->yt - e->yb);
+    if (d != 0) return d < 0;
+    return ei < fi;
+}
+/*-------------------------------------------------------*/
+static int edgeCrossing(const FillEdge *a, const FillEdge *b, Coord y, Coord *yc)
+{
+/* Where edge a, left of edge b at y, crosses it further down. Returns 1
+ * with the crossing in *yc, rounded to a Coord, if that is below y and
+ * above the bottom of both; -1 if they are out of order just below y (a
+ * crossing that rounds to y, or x at y off by rounding); else 0. */
+    Coord ybot = (a->yb > b->yb)? a->yb: b->yb;
+    double d0 = edgeAt(b, y) - edgeAt(a, y), d1 = (double)edgeAt(b, ybot) - edgeAt(a, ybot), yy;
+
+    if (d1 >= 0) return 0;
+    if (d0 < 0) return -1;
+    yy = y - ((double)y - ybot) * d0/(d0 - d1);
+#ifdef FIXED_COORDS
+    yy = floor(yy + .5);
+#endif
+    *yc = (Coord)yy;
+    if (*yc >= y) return -1;
+    return *yc > ybot;
+}
+/*-------------------------------------------------------*/
+static int pushCrossing(FillContext *fc, int *numb, Coord y, int e, int f)
+{
+/* Add the crossing at y of edge e with its right neighbour f to the heap
+ * fc->crossings[0 .. *numb-1]. Returns -1 if out of memory. */
+    EdgeCrossing *h;
+    int i = (*numb)++, parent;
+
+    if (growBuffer((void**)&fc->crossings, &fc->maxCrossings, *numb, NUMB_WS, sizeof(EdgeCrossing)))
+        return -1;
+    h = fc->crossings;
+    for (; i > 0 && h[parent = (i - 1)/2].y < y; i = parent) h[i] = h[parent];
+    h[i].y = y;
+    h[i].left = e;
+    h[i].right = f;
+    return 0;
+}
+/*-------------------------------------------------------*/
+static EdgeCrossing popCrossing(FillContext *fc, int *numb)
+{
+/* Remove the highest crossing from the heap fc->crossings[0 .. *numb-1]
+ * and return it */
+    EdgeCrossing *h = fc->crossings, last = h[--(*numb)], top = h[0];
+    int i = 0, child;
+
+    for (; (child = 2*i + 1) < *numb; i = child) {
+        if (child + 1 < *numb && h[child+1].y > h[child].y) child++;
+        if (!(h[child].y > last.y)) break;
+        h[i] = h[child];
+    }
+    h[i] = last;
+    return top;
+}
+/*-------------------------------------------------------*/
+static int sideEdge(FillContext *fc, int e, int right)
+{
+/* Neighbour of edge e in the sweep, on the right if right is set, or -1 */
+    TreapNode *t = fc->treapNodes + fc->fillEdges[e].node;
+
+    t = right? treapNext(t): treapPrev(t);
+    return t? t->edge: -1;
+}
+/*-------------------------------------------------------*/
+static void swapEdges(FillContext *fc, int e, int f)
+{
+/* Swap edge e with its right neighbour f in the sweep */
+    FillEdge *edges = fc->fillEdges;
+    int t = edges[e].node;
+
+    fc->treapNodes[t].edge = f;
+    fc->treapNodes[edges[f].node].edge = e;
+    edges[e].node = edges[f].node;
+    edges[f].node = t;
+}
+/*-------------------------------------------------------*/
+static int newTrapezoid(FillContext *fc, int *freeTrap, int *numbTraps)
+{
+/* A free trapezoid, or a new one. Returns -1 if out of memory. */
+    int t = *freeTrap;
+
+    if (t >= 0) {
+        *freeTrap = fc->trapezoids[t].below;
+        return t;
+    }
+    if (growBuffer((void**)&fc->trapezoids, &fc->maxTrapezoids, *numbTraps + 1, NUMB_WS,
+                   sizeof(Trapezoid)))
+        return -1;
+    return (*numbTraps)++;
+}
+/*-------------------------------------------------------*/
+static void trapezoidEnd(FillContext *fc, Trapezoid *u, Coord y, Coord *xl, Coord *xr)
+{
+/* Left and right x of trapezoid u at y, made the same where its edges
+ * cross in rounding */
+    *xl = spanX(fc->fillEdges + u->left, y);
+    *xr = spanX(fc->fillEdges + u->right, y);
+    if (*xl > *xr) *xl = *xr = *xl + (*xr - *xl)/2;
+}
+/*-------------------------------------------------------*/
+static int endRun(FillContext *fc, int t, int n, int *freeTrap)
+{
+/* Output the run of trapezoids that ends with fc->trapezoids[t], unless
+ * it is that one and has no area, and free them. Returns -1 if out of
+ * memory or the sink stopped. */
+    Trapezoid *traps = fc->trapezoids, *u = traps + t;
+    int status = 0, k, next = u->first;
+#ifdef FILL_STATS
+    double start = statsTime(), time;
+#endif
+
+    if (next != t || u->xlt != u->xrt || u->xlb != u->xrb) {
+        status = fc->triangulate? triangulateTrapezoids(fc, next, n): makeTrapezoidSequence(fc, next);
+        traps = fc->trapezoids;
+        STATS(fc->stats.pieces++);
+    }
+    do {
+        k = next;
+        next = traps[k].below;
+        traps[k].below = *freeTrap;
+        *freeTrap = k;
+    } while (k != t);
+#ifdef FILL_STATS
+    time = statsTime() - start;
+    fc->stats.seconds[EMIT_PIECES] += time;
+    fc->stats.seconds[SWEEP_BANDS] -= time; /* which it is called from */
+#endif
+    return status;
+}
+/*-------------------------------------------------------*/
+/* all of the plane, as the strips of appendFilled() */
+static const Coord noStrips[2] = {COORD_MAX, -COORD_MAX};
+/* edge e is touched at the current stop of the sweep */
+#define TOUCH(e) do { if (edges[e].touched != stop) { \
+                          edges[e].touched = stop; touched[numbTouched++] = (e); } } while (0)
+/* winding number w is filled by fc->fillRule */
+#define FILLED(w) ((fc->fillRule == EVEN_ODD)? ((w) & 1): ((w) != 0))
+/*-------------------------------------------------------*/
+static int appendFilled(FillContext *fc, int numbRings, Point v[], const int ringOffsets[],
+                        const Coord strips[], int numbStrips, int stripWs[], const int edgeList[],
+                        int numbEdges)
+{
+/*----------------------------------------------
+ * Decompose the region the rings fill by fc->fillRule (ORIENTED as
+ * NON_ZERO), between strips[numbStrips] and strips[0]. The rings may
+ * have either orientation, and cross and overlap each other.
+ *
+ * The joins of appendRings() need rings that do not cross, so this is a
+ * sweep down over the non-horizontal edges instead. It stops at the top
+ * and bottom of each edge, and where two edges that are neighbours by x
+ * cross (a heap holds the crossings found so far). The edges it crosses
+ * are in a treap by x, each with the winding number of the rings right
+ * of it. A stop touches only the edges that start, end or cross there,
+ * and the ones under a horizontal edge there, whose winding number
+ * changes; so the sweep takes O((n + k) log n) for k crossings.
+ *
+ * Between two neighbours with a filled winding number between them is a
+ * trapezoid, from the stop where they become neighbours to the one where
+ * they stop being. One that starts where another ended, with the same
+ * corners, continues it. Each run of trapezoids is a monotone piece,
+ * output as one wedge sequence (or its triangles) at the stop where it
+ * ends, and its trapezoids are reused: only the open runs are kept.
+ *
+ * The sweep also stops at the strips[] between, which are in descending
+ * order, and no piece goes past one. The output of strip s starts at
+ * stripWs[s] (counted from the first output of this call, and
+ * stripWs[numbStrips] is its end) if stripWs is not NULL.
+ *
+ * If edgeList is not NULL, only the edges from the vertices
+ * edgeList[0 .. numbEdges-1] to the next vertex of their ring are taken:
+ * all the edges through the strips, as fillStrips() keeps them.
+ *
+ * Returns the number of wedge sequences (or triangles) added, or -1 if
+ * out of memory or the sink stopped.
+ */
+    int i, j, k, r, lo, e, f, g, t, w, n = ringOffsets[numbRings], /* number of vertices */
+        m = 0, /* number of edges */
+        nextTop = 0, nextBottom = 0, numbCrossings = 0, /* edges to come in, go, crossings */
+        stop = 0, numbTouched, numbClosed, numbTraps = 0, freeTrap = -1,
+        strip = 0, cut, /* strip of the stop, whether one ends there */
+        passes, swapped, mid,
+        first = fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk; /* first output */
+    int *touched, *closed; /* edges touched at the stop, trapezoids ended there */
+    FillEdge *edges, *a;
+    Trapezoid *u, *p;
+    EdgeCrossing c;
+    TreapNode *root = NULL, *s, *parent;
+    JoinKey *tops, *bottoms, *keys;
+    Coord y0, yc;
+
+    STATS(double phaseStart = statsTime());
+
+    if (!edgeList) numbEdges = n;
+    if (reserveWedges(fc, fc->numbWs + 1, 0) ||
+        growBuffer((void**)&fc->fillEdges, &fc->maxFillEdges, numbEdges, numbEdges, sizeof(FillEdge)) ||
+        growBuffer((void**)&fc->activeEdges, &fc->maxActive, 2*numbEdges, 2*numbEdges, sizeof(int)) ||
+        growBuffer((void**)&fc->treapNodes, &fc->maxTreap, numbEdges, numbEdges, sizeof(TreapNode)) ||
+        growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 6*numbEdges, 6*numbEdges, sizeof(JoinKey)))
+        return -1;
+    edges = fc->fillEdges;
+    touched = fc->activeEdges;
+    closed = fc->activeEdges + numbEdges;
+
+    /* the edges, by top and by bottom from the top down */
+    keys = fc->joinKeys;
+    for (k = 0, r = 0; k < numbEdges; k++) {
+        if (edgeList) r = ringOf(ringOffsets, numbRings, i = edgeList[k]);
+        else for (i = k; ringOffsets[r+1] <= i; r++) {}
+        j = (i + 1 < ringOffsets[r+1])? i + 1: ringOffsets[r];
+        if (v[i].y == v[j].y) continue;
+        lo = (v[j].y > v[i].y)? i: j;
+        a = edges + m;
+        a->wind = (lo == i)? 1: -1;
+        a->xb = v[lo].x;
+        a->yb = v[lo].y;
+        a->xt = v[i + j - lo].x;
+        a->yt = v[i + j - lo].y;
+        a->slope = (Real)(a->xt - a->xb)/(a->yt - a->yb);
+        if (a->yt <= strips[numbStrips] || a->yb >= strips[0]) continue;
+        if (a->yt > strips[0]) {
+            a->xt = spanX(a, strips[0]);
+            a->yt = strips[0];
+            a->slope = (Real)(a->xt - a->xb)/(a->yt - a->yb);
+        }
+        if (a->yb < strips[numbStrips]) {
+            a->xb = spanX(a, strips[numbStrips]);
+            a->yb = strips[numbStrips];
+            a->slope = (Real)(a->xt - a->xb)/(a->yt - a->yb);
+        }
+        a->node = a->trap = -1;
+        a->right = a->touched = a->wound = 0;
+        setKey(&keys[m], (CoordKey)~coordKey(a->yt), 0, m);
+        setKey(&keys[2*numbEdges + m], (CoordKey)~coordKey(a->yb), 0, m);
+        m++;
+    }
+    tops = sortKeys(keys, keys + numbEdges, m);
+    bottoms = sortKeys(keys + 2*numbEdges, keys + 3*numbEdges, m);
+    keys += 4*numbEdges; /* and as many again for scratch */
+    STATS(endPhase(fc, BUILD_RINGS, &phaseStart));
+
+    if (stripWs) stripWs[0] = 0;
+    for (;;) {
+        /* the next stop: the highest top, bottom, crossing or strip end to come */
+        cut = strip < numbStrips - 1;
+        if (nextTop < m) {
+            y0 = edges[tops[nextTop].node].yt;
+            if (edges[bottoms[nextBottom].node].yb > y0) y0 = edges[bottoms[nextBottom].node].yb;
+        } else if (nextBottom < m) y0 = edges[bottoms[nextBottom].node].yb;
+        else if (cut) y0 = strips[strip+1];
+        else break;
+        if (numbCrossings && fc->crossings[0].y > y0) y0 = fc->crossings[0].y;
+        if (cut && strips[strip+1] > y0) y0 = strips[strip+1];
+        cut = cut && strips[strip+1] == y0;
+        stop++;
+        numbTouched = numbClosed = 0;
+
+        /* neighbours that cross here swap (a crossing is stale if they
+         * stopped being neighbours, or swapped already) */
+        while (numbCrossings && fc->crossings[0].y == y0) {
+            c = popCrossing(fc, &numbCrossings);
+            e = c.left;
+            f = c.right;
+            if (edges[e].node < 0 || sideEdge(fc, e, 1) != f) continue;
+            swapEdges(fc, e, f);
+            TOUCH(e);
+            TOUCH(f);
+        }
+
+        /* the edges ending here go, the ones starting here come in */
+        while (nextBottom < m && edges[e = bottoms[nextBottom].node].yb == y0) {
+            nextBottom++;
+            if ((t = edges[e].trap) >= 0) closed[numbClosed++] = t;
+            if ((f = sideEdge(fc, e, 0)) >= 0) TOUCH(f);
+            if ((f = sideEdge(fc, e, 1)) >= 0) TOUCH(f);
+            treapRemove(&root, fc->treapNodes + edges[e].node);
+            edges[e].node = -1;
+        }
+        while (nextTop < m && edges[e = tops[nextTop].node].yt == y0) {
+            nextTop++;
+            for (parent = NULL, s = root, k = 0; s; s = k? s->left: s->right) {
+                parent = s;
+                k = startsLeftOf(edges + e, e, edges + s->edge, s->edge, y0);
+            }
+            s = fc->treapNodes + e;
+            s->prio = treapPriority((unsigned)e);
+            s->edge = e;
+            treapInsert(&root, s, parent, k);
+            edges[e].node = e;
+            TOUCH(e);
+        }
+        if (cut && root) { /* every run ends */
+            for (s = root; s->left; s = s->left) {}
+            for (; s; s = treapNext(s)) TOUCH(s->edge);
+        }
+
+        /* neighbours out of order just below here (by rounding, or
+         * crossing here) swap, until none are */
+        for (passes = 0, swapped = 1; swapped && passes <= numbTouched; passes++)
+            for (i = 0, swapped = 0; i < numbTouched; i++) {
+                e = touched[i];
+                if (edges[e].node < 0) continue;
+                if ((f = sideEdge(fc, e, 1)) >= 0 && edgeCrossing(edges + e, edges + f, y0, &yc) < 0) {
+                    swapEdges(fc, e, f);
+                    TOUCH(f);
+                    swapped = 1;
+                }
+                if ((f = sideEdge(fc, e, 0)) >= 0 && edgeCrossing(edges + f, edges + e, y0, &yc) < 0) {
+                    swapEdges(fc, f, e);
+                    TOUCH(f);
+                    swapped = 1;
+                }
+            }
+
+        /* Winding numbers, from the left of each stretch of touched
+         * edges, in the order of x. Past it they go on to the edges
+         * under a horizontal edge here, whose winding number changes. */
+        for (i = j = 0; i < numbTouched; i++)
+            if (edges[e = touched[i]].node >= 0) setKey(&keys[j++], coordKey(spanX(edges + e, y0)), 0, e);
+        for (keys = sortKeys(keys, keys + numbEdges, j), i = 0; i < j; i++) {
+            if (edges[e = keys[i].node].wound == stop) continue;
+            while ((f = sideEdge(fc, e, 0)) >= 0 && edges[f].touched == stop && edges[f].wound != stop) e = f;
+            for (w = (f >= 0)? edges[f].right: 0; ; e = f) {
+                w += edges[e].wind;
+                if ((edges[e].touched != stop || edges[e].wound == stop) && edges[e].right == w) break;
+                TOUCH(e);
+                edges[e].right = w;
+                edges[e].wound = stop;
+                if ((f = sideEdge(fc, e, 1)) < 0) break;
+            }
+        }
+        keys = fc->joinKeys + 4*numbEdges;
+
+        /* the trapezoids right of the touched edges and their left
+         * neighbours end if the neighbours change or it is not filled */
+        for (i = 0; i < numbTouched; i++) {
+            if (edges[e = touched[i]].node < 0) continue;
+            for (k = 0, g = e; k < 2 && g >= 0; k++, g = sideEdge(fc, e, 0)) {
+                if ((t = edges[g].trap) < 0) continue;
+                f = sideEdge(fc, g, 1);
+                if (cut || f != fc->trapezoids[t].right || !FILLED(edges[g].right)) {
+                    closed[numbClosed++] = t;
+                    edges[g].trap = -1;
+                }
+            }
+        }
+        for (i = 0; i < numbClosed; i++) {
+            u = fc->trapezoids + closed[i];
+            u->yb = y0;
+            trapezoidEnd(fc, u, y0, &u->xlb, &u->xrb);
+            setKey(&keys[i], coordKey(u->xlb), coordKey(u->xrb), closed[i]);
+        }
+        keys = sortKeys(keys, keys + numbEdges, numbClosed);
+
+        /* and new ones start, continuing one that ended at their top */
+        for (i = 0; i < numbTouched; i++) {
+            if (edges[e = touched[i]].node < 0) continue;
+            for (k = 0, g = e; k < 2 && g >= 0; k++, g = sideEdge(fc, e, 0)) {
+                if (edges[g].trap >= 0 || !FILLED(edges[g].right) || (f = sideEdge(fc, g, 1)) < 0)
+                    continue;
+                if ((t = newTrapezoid(fc, &freeTrap, &numbTraps)) < 0) return -1;
+                u = fc->trapezoids + t;
+                u->left = g;
+                u->right = f;
+                u->yt = y0;
+                trapezoidEnd(fc, u, y0, &u->xlt, &u->xrt);
+                u->below = -1;
+                u->first = t;
+                edges[g].trap = t;
+                if (cut) continue;
+                for (lo = 0, j = numbClosed; lo < j; ) { /* first ended one with the same corners */
+                    mid = (lo + j)/2;
+                    p = fc->trapezoids + keys[mid].node;
+                    if (p->xlb < u->xlt || (p->xlb == u->xlt && p->xrb < u->xrt)) lo = mid + 1;
+                    else j = mid;
+                }
+                for (; lo < numbClosed; lo++) {
+                    p = fc->trapezoids + keys[lo].node;
+                    if (p->xlb != u->xlt || p->xrb != u->xrt) break;
+                    if (p->below < 0) {
+                        p->below = t;
+                        u->first = p->first;
+                        break;
+                    }
+                }
+            }
+        }
+
+        /* the runs that ended are output */
+        for (i = 0; i < numbClosed; i++)
+            if (fc->trapezoids[keys[i].node].below < 0 && endRun(fc, keys[i].node, n, &freeTrap)) {
+                fc->ws[fc->numbWs].opcode = END;
+                return -1;
+            }
+        keys = fc->joinKeys + 4*numbEdges;
+        if (cut) {
+            strip++;
+            if (stripWs) stripWs[strip] = (fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk) - first;
+        }
+
+        /* and the crossings of the new neighbours are to come */
+        for (i = 0; i < numbTouched; i++) {
+            if (edges[e = touched[i]].node < 0) continue;
+            if ((f = sideEdge(fc, e, 1)) >= 0 && edgeCrossing(edges + e, edges + f, y0, &yc) > 0 &&
+                pushCrossing(fc, &numbCrossings, yc, e, f))
+                return -1;
+            if ((f = sideEdge(fc, e, 0)) >= 0 && edges[f].touched != stop &&
+                edgeCrossing(edges + f, edges + e, y0, &yc) > 0 && pushCrossing(fc, &numbCrossings, yc, f, e))
+                return -1;
+        }
+    }
+    STATS(endPhase(fc, SWEEP_BANDS, &phaseStart));
+    fc->ws[fc->numbWs].opcode = END;
+    k = (fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk) - first;
+    if (stripWs)
+        while (strip < numbStrips) stripWs[++strip] = k;
+    return k;
+}
+/*-------------------------------------------------------*/
+static int onClipSide(const FillContext *fc, const Point *a, const Point *b, const Point *c)
+{
+/* a, b and c all lie on the line through one side of the clip rectangle */
+    if (a->x == b->x && b->x == c->x && (a->x == fc->clipMin.x || a->x == fc->clipMax.x))
+        return 1;
+    return a->y == b->y && b->y == c->y && (a->y == fc->clipMin.y || a->y == fc->clipMax.y);
+}
+/*-------------------------------------------------------*/
+static Coord clipCoord(double c, Coord lo, Coord hi)
+{
+/* c rounded to a coordinate, and clamped to lo .. hi */
+#ifdef FIXED_COORDS
+    c = floor(c + .5);
+#endif
+    if (c < lo) return lo;
+    if (c > hi) return hi;
+    return (Coord)c;
+}
+/*-------------------------------------------------------*/
+static Coord nextCoord(Coord c)
+{
+/* The least coordinate above c */
+#if defined(FIXED_COORDS)
+    return c + 1;
+#elif defined(DOUBLE_COORDS)
+    return nextafter(c, HUGE_VAL);
+#else
+    return nextafterf(c, HUGE_VALF);
+#endif
+}
+/*-------------------------------------------------------*/
+static int addClipped(FillContext *fc, int numbOut, int first, double x, double y, int vertex)
+{
+/* Append (x, y), clamped to the clip rectangle, to the ring that starts
+ * at fc->clipPoints[first] and ends before numbOut, unless it repeats the
+ * last point. A point between two others on the same side is dropped, and
+ * so is one that the ring goes back from to the point before it (where
+ * rounding made a spike).
+ * vertex is the vertex of the rings that the point is, or -1.
+ * Returns the new end of the ring, or -1 if out of memory. */
+    Point p, *o;
+
+    if (growBuffer((void**)&fc->clipPoints, &fc->maxClipPoints, numbOut + 1, NUMB_WS, sizeof(Point)) ||
+        growBuffer((void**)&fc->clipVertices, &fc->maxClipVertices, numbOut + 1, NUMB_WS, sizeof(int)))
+        return -1;
+    o = fc->clipPoints;
+    p.x = clipCoord(x, fc->clipMin.x, fc->clipMax.x);
+    p.y = clipCoord(y, fc->clipMin.y, fc->clipMax.y);
+    for (;;) {
+        if (numbOut > first && o[numbOut-1].x == p.x && o[numbOut-1].y == p.y) {
+            if (fc->clipVertices[numbOut-1] < 0) fc->clipVertices[numbOut-1] = vertex;
+            return numbOut;
+        }
+        if (numbOut - first < 2 || (!onClipSide(fc, o + numbOut - 2, o + numbOut - 1, &p) &&
+                                    (o[numbOut-2].x != p.x || o[numbOut-2].y != p.y)))
+            break;
+        numbOut--;
+    }
+    o[numbOut] = p;
+    fc->clipVertices[numbOut] = vertex;
+    return numbOut + 1;
+}
+/*-------------------------------------------------------*/
+static int closeClipped(FillContext *fc, int numbOut, int first)
+{
+/* Close the ring from fc->clipPoints[first] to numbOut as addClipped()
+ * went on: points repeated, on one side with their neighbours or at the
+ * tip of a spike at either end go, and what has no area goes. Returns
+ * the new end. */
+    Point *o = fc->clipPoints;
+    int *ov = fc->clipVertices;
+
+    while (numbOut - first >= 3) {
+        if (o[numbOut-1].x == o[first].x && o[numbOut-1].y == o[first].y) {
+            if (ov[first] < 0) ov[first] = ov[numbOut-1];
+            numbOut--;
+        } else if (onClipSide(fc, o + numbOut - 2, o + numbOut - 1, o + first) ||
+                   (o[numbOut-2].x == o[first].x && o[numbOut-2].y == o[first].y))
+            numbOut--;
+        else if (onClipSide(fc, o + numbOut - 1, o + first, o + first + 1) ||
+                 (o[numbOut-1].x == o[first+1].x && o[numbOut-1].y == o[first+1].y)) {
+            numbOut--;
+            memmove(o + first, o + first + 1, (numbOut - first) * sizeof(Point));
+            memmove(ov + first, ov + first + 1, (numbOut - first) * sizeof(int));
+        } else break;
+    }
+    return (numbOut - first < 3)? first: numbOut;
+}
+/*-------------------------------------------------------*/
+static int insideClip(const FillContext *fc, int n, const Point v[])
+{
+/* All of v[0 .. n-1] is inside the clip rectangle or on its boundary */
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (v[i].x < fc->clipMin.x || v[i].x > fc->clipMax.x ||
+            v[i].y < fc->clipMin.y || v[i].y > fc->clipMax.y)
+            return 0;
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int clipSide(const FillContext *fc, Point p)
+{
+/* Side of the clip rectangle that p is on, clockwise from the left one:
+ * 0 left (going up), 1 top, 2 right (going down), 3 bottom. A corner is
+ * on the side it ends, the bottom-left one on the left side it starts. */
+    if (p.x == fc->clipMin.x) return 0;
+    if (p.y == fc->clipMax.y) return 1;
+    if (p.x == fc->clipMax.x) return 2;
+    return 3;
+}
+static unsigned clipTurn(const FillContext *fc, const Point v[], const int ringOffsets[], const ClipPiece *pc,
+                         int enters)
+{
+/* Order of where the piece pc enters (or leaves) among the ones at the
+ * same point: by which way it goes in from there (or comes back from),
+ * from going back along the side to going on along it clockwise, then
+ * leaving first; but entering first if it comes back to where it entered
+ * counterclockwise, with the region around it */
+    int i, c, r = ringOffsets[pc->ring], m = ringOffsets[pc->ring + 1] - r;
+    Point p = enters? pc->in: pc->out, q = enters? pc->out: pc->in;
+    unsigned turn = 0x80000000u;
+    double a, b, dx, dy, area;
+
+    for (c = 0; c < pc->numb; c++) {
+        i = r + (pc->first - r + (enters? c: pc->numb - 1 - c)) % m;
+        if (v[i].x != p.x || v[i].y != p.y) {
+            q = v[i];
+            break;
+        }
+    }
+    dx = (double)q.x - p.x;
+    dy = (double)q.y - p.y;
+    switch (clipSide(fc, p)) {
+    case 0: a = dy; b = dx; break;
+    case 1: a = dx; b = -dy; break;
+    case 2: a = -dy; b = -dx; break;
+    default: a = -dx; b = dy; break;
+    }
+    if (b < 0) b = 0;
+    if (a != 0 || b != 0) turn = (unsigned)((a/(fabs(a) + b) + 1) * 2147483647.0);
+
+    if (pc->in.x == pc->out.x && pc->in.y == pc->out.y) {
+        for (c = 0, area = 0, q = pc->in; c < pc->numb; c++, q = v[i]) {
+            i = r + (pc->first - r + c) % m;
+            area += (double)q.x * v[i].y - (double)v[i].x * q.y;
+        }
+        area += (double)q.x * pc->in.y - (double)pc->in.x * q.y;
+        if (area > 0) enters = !enters;
+    }
+    return (turn & ~1u) | enters;
+}
+#define CLIP_TURN(c) clipTurn(fc, v, ringOffsets, fc->clipPieces + (c)/2, (c) & 1)
+/* the vertex v[i] is inside the clip rectangle or on its boundary */
+#define IN_CLIP(fc, v, i) ((v)[i].x >= (fc)->clipMin.x && (v)[i].x <= (fc)->clipMax.x && \
+                           (v)[i].y >= (fc)->clipMin.y && (v)[i].y <= (fc)->clipMax.y)
+/* and not on its boundary */
+#define INSIDE_CLIP(fc, v, i) ((v)[i].x > (fc)->clipMin.x && (v)[i].x < (fc)->clipMax.x && \
+                               (v)[i].y > (fc)->clipMin.y && (v)[i].y < (fc)->clipMax.y)
+/*-------------------------------------------------------*/
+static int edgeInClip(const FillContext *fc, Point p, Point q, Point *in, Point *out, double at[2])
+{
+/* Where the edge from p to q enters the clip rectangle (*in) and where
+ * it leaves it (*out): p and q if they are inside, or else a point with
+ * the coordinate of the side it is on, and where along that side they
+ * are before rounding (at[0], at[1]). Returns 0 if the edge misses the
+ * rectangle, or only touches it at a point from outside. */
+    double t[2] = {0, 1}, a, d, lim, tt, x, y;
+    int l, k, s[2] = {-1, -1};
+
+    /* l = 0, 1: x = clipMin.x, clipMax.x; l = 2, 3: y; k = 0 entering, 1 leaving */
+    for (l = 0; l < 4; l++) {
+        a = (l < 2)? p.x: p.y;
+        d = (l < 2)? (double)q.x - p.x: (double)q.y - p.y;
+        lim = (l == 0)? fc->clipMin.x: (l == 1)? fc->clipMax.x: (l == 2)? fc->clipMin.y: fc->clipMax.y;
+        if (d == 0) {
+            if ((l & 1)? a > lim: a < lim) return 0;
+            continue;
+        }
+        tt = (lim - a)/d;
+        k = (((l & 1) == 0) == (d > 0))? 0: 1;
+        if (k == 0? tt > t[0]: tt < t[1]) {
+            t[k] = tt;
+            s[k] = l;
+        }
+    }
+    if (t[0] > t[1] || (t[0] == t[1] && s[0] >= 0 && s[1] >= 0)) return 0;
+
+    for (k = 0; k < 2; k++) {
+        l = s[k];
+        if (l < 0) {
+            x = k? q.x: p.x;
+            y = k? q.y: p.y;
+        } else {
+            x = (l < 2)? ((l == 0)? fc->clipMin.x: fc->clipMax.x): p.x + t[k]*((double)q.x - p.x);
+            y = (l >= 2)? ((l == 2)? fc->clipMin.y: fc->clipMax.y): p.y + t[k]*((double)q.y - p.y);
+        }
+        (k? out: in)->x = clipCoord(x, fc->clipMin.x, fc->clipMax.x);
+        (k? out: in)->y = clipCoord(y, fc->clipMin.y, fc->clipMax.y);
+        at[k] = (clipSide(fc, *(k? out: in)) & 1)? x: y;
+    }
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int clipRings(FillContext *fc, int numbRings, const Point v[], const int ringOffsets[])
+{
+/*----------------------------------------------
+ * Cut the (ORIENTED) rings to the clip rectangle, into fc->clipPoints
+ * and fc->clipOffsets, with the vertex of v each point is, or -1, in
+ * fc->clipVertices.
+ *
+ * Each run of a ring inside the rectangle, from where the ring enters it
+ * to where it leaves, is a piece. The region is on the right of the
+ * rings, and of the sides gone round clockwise; so from where a piece
+ * leaves, the sides bound the region inside up to where the next piece
+ * clockwise enters, and that piece follows it, with the corners passed
+ * on the way. Following the pieces makes the rings of the part inside.
+ * Rings wholly inside are kept as they are, and rings wholly outside are
+ * left out, but if no ring crosses a side, the rectangle is a ring of
+ * its own where they wind around it.
+ *
+ * Returns the number of rings, -1 if out of memory, or -3 if going round
+ * the sides does not meet the pieces leaving and entering in turn (as
+ * when the rings cross), or if rings made would touch where they meet
+ * the sides (where a vertex is on a side and the region only touches
+ * it), which appendRings() does not take.
+ */
+    int i, j, k, l, m, c, s, a, b, q, next, first,
+        numbOut = 0, numbPieces = 0, numbClipped = 0,
+        piece, /* piece being made, or -1 */
+        count[5]; /* crossings on each side, then where each side starts */
+    ClipPiece *pc;
+    JoinKey *keys, *sorted, key;
+    Point in, out, p, *cp;
+    Coord *co, last = 0;
+    double at[2], cx, cy, x, prev = 0;
+
+    /* the pieces, each from an edge that enters; a vertex on a side ends
+     * one and starts the next, so that no other one goes by it along the
+     * side, and a ring with none outside or on a side is wholly inside */
+    for (k = 0; k < numbRings; k++) {
+        m = ringOffsets[k+1] - ringOffsets[k];
+        if (m < 3) continue;
+        for (s = 0; s < m && INSIDE_CLIP(fc, v, ringOffsets[k] + s); s++);
+        for (c = 0, piece = -1; s < m && c < m; c++) {
+            i = ringOffsets[k] + (s + c) % m;
+            j = ringOffsets[k] + (s + c + 1) % m;
+            if (piece < 0) {
+                if (!edgeInClip(fc, v[i], v[j], &in, &out, at)) continue;
+                if (growBuffer((void**)&fc->clipPieces, &fc->maxClipPieces, numbPieces + 1, NUMB_WS,
+                               sizeof(ClipPiece)))
+                    return -1;
+                pc = fc->clipPieces + (piece = numbPieces++);
+                pc->in = in;
+                pc->out = out;
+                pc->at[0] = at[0];
+                pc->at[1] = at[1];
+                pc->first = j;
+                pc->numb = 0;
+                pc->ring = k;
+            }
+            pc = fc->clipPieces + piece;
+            if (IN_CLIP(fc, v, j)) {
+                pc->numb++;
+                if (INSIDE_CLIP(fc, v, j)) continue;
+                pc->out = v[j];
+                pc->at[1] = (clipSide(fc, v[j]) & 1)? v[j].x: v[j].y;
+            } else if (pc->numb > 0) {
+                edgeInClip(fc, v[i], v[j], &in, &pc->out, at);
+                pc->at[1] = at[1];
+            }
+
+            /* the piece is done: one that only touches the sides at a point adds nothing */
+            if (pc->in.x == pc->out.x && pc->in.y == pc->out.y &&
+                (pc->numb == 0 || (pc->numb == 1 && v[pc->first].x == pc->in.x && v[pc->first].y == pc->in.y)))
+                numbPieces--;
+            piece = -1;
+        }
+    }
+
+    if (growBuffer((void**)&fc->clipOffsets, &fc->maxClipOffsets, numbRings + 2, numbRings + 2,
+                   sizeof(int)))
+        return -1;
+    fc->clipOffsets[0] = 0;
+    if (numbPieces > 0) {
+        /* where they leave (2*piece) and enter (2*piece + 1), clockwise
+         * round the sides, and at the same point by the way they go in */
+        if (growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 4*numbPieces, 4*numbPieces, sizeof(JoinKey)))
+            return -1;
+        keys = fc->joinKeys;
+        memset(count, 0, sizeof(count));
+        for (c = 0; c < 2*numbPieces; c++) {
+            pc = fc->clipPieces + c/2;
+            count[clipSide(fc, (c & 1)? pc->in: pc->out) + 1]++;
+        }
+        for (l = 1; l < 5; l++) count[l] += count[l-1];
+        for (c = 0; c < 2*numbPieces; c++) {
+            pc = fc->clipPieces + c/2;
+            l = clipSide(fc, (c & 1)? pc->in: pc->out);
+            x = (c & 1)? pc->at[0]: pc->at[1];
+            keys[count[l]].key = doubleKey((l < 2)? x: -x);
+#ifdef DOUBLE_COORDS
+            keys[count[l]].low = 0;
+#endif
+            keys[count[l]++].node = c;
+        }
+        for (l = 0, a = 0; l < 4; a = count[l++]) {
+            sorted = sortKeys(keys + a, keys + 2*numbPieces + a, count[l] - a);
+            if (sorted != keys + a) memcpy(keys + a, sorted, (count[l] - a) * sizeof(JoinKey));
+            for (i = a + 1; i < count[l]; i++) /* at the same point */
+                for (j = i; j > a && keys[j-1].key == keys[j].key &&
+                            CLIP_TURN(keys[j-1].node) > CLIP_TURN(keys[j].node); j--) {
+                    key = keys[j];
+                    keys[j] = keys[j-1];
+                    keys[j-1] = key;
+                }
+
+            /* Crossings apart that round to the same point would make
+             * the rings touch there: each goes up (or right) from the one
+             * below it by the least step. Going the same way on both,
+             * the slabs either side of a side of fillSlabs() still cut
+             * the rings at the same points. */
+            for (i = 0; i < count[l] - a; i++) {
+                c = keys[(l < 2)? a + i: count[l] - 1 - i].node;
+                pc = fc->clipPieces + c/2;
+                cp = (c & 1)? &pc->in: &pc->out;
+                co = (l & 1)? &cp->x: &cp->y;
+                x = (c & 1)? pc->at[0]: pc->at[1];
+                if (i > 0 && x == prev) *co = last;
+                else if (i > 0 && *co <= last) {
+                    *co = nextCoord(last);
+                    if (*co > ((l & 1)? fc->clipMax.x: fc->clipMax.y)) return -3;
+                }
+                prev = x;
+                last = *co;
+            }
+        }
+
+        /* from each leaving to the next entering */
+        for (s = 0; keys[s].node & 1; s++);
+        for (c = 0; c < 2*numbPieces; c += 2) {
+            i = keys[(s + c) % (2*numbPieces)].node;
+            j = keys[(s + c + 1) % (2*numbPieces)].node;
+            if ((i & 1) || !(j & 1)) return -3;
+            pc = fc->clipPieces + i/2;
+            pc->next = j/2;
+            a = clipSide(fc, pc->out);
+            b = clipSide(fc, fc->clipPieces[j/2].in);
+            pc->corners = (b - a + 4) % 4;
+            if (a == b && (s + c) % (2*numbPieces) == 2*numbPieces - 1) pc->corners = 4; /* all round */
+        }
+
+        /* the rings they make */
+        for (piece = 0; piece < numbPieces; piece++) {
+            if (fc->clipPieces[piece].next < 0) continue;
+            first = numbOut;
+            for (q = piece; fc->clipPieces[q].next >= 0; q = next) {
+                pc = fc->clipPieces + q;
+                k = pc->ring;
+                m = ringOffsets[k+1] - ringOffsets[k];
+                if ((numbOut = addClipped(fc, numbOut, first, pc->in.x, pc->in.y, -1)) < 0) return -1;
+                for (c = 0, i = pc->first; c < pc->numb; c++) {
+                    if ((numbOut = addClipped(fc, numbOut, first, v[i].x, v[i].y, i)) < 0) return -1;
+                    i = (i + 1 < ringOffsets[k] + m)? i + 1: ringOffsets[k];
+                }
+                if ((numbOut = addClipped(fc, numbOut, first, pc->out.x, pc->out.y, -1)) < 0) return -1;
+                for (c = 0, l = clipSide(fc, pc->out); c < pc->corners; c++, l = (l + 1) % 4) { /* end of side l */
+                    numbOut = addClipped(fc, numbOut, first, (l == 0 || l == 3)? fc->clipMin.x: fc->clipMax.x,
+                                         (l < 2)? fc->clipMax.y: fc->clipMin.y, -1);
+                    if (numbOut < 0) return -1;
+                }
+                next = pc->next;
+                pc->next = -1;
+            }
+            numbOut = closeClipped(fc, numbOut, first);
+            if (numbOut > first) {
+                if (growBuffer((void**)&fc->clipOffsets, &fc->maxClipOffsets, numbClipped + 2, numbRings + 2,
+                               sizeof(int)))
+                    return -1;
+                fc->clipOffsets[++numbClipped] = numbOut;
+            }
+        }
+
+        /* no point on the sides twice: the rings would touch there */
+        if (growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 2*numbOut, 2*numbOut, sizeof(JoinKey)))
+            return -1;
+        keys = fc->joinKeys;
+        for (i = 0, c = 0; i < numbOut; i++) {
+            p = fc->clipPoints[i];
+            if (p.x == fc->clipMin.x || p.x == fc->clipMax.x || p.y == fc->clipMin.y || p.y == fc->clipMax.y)
+                setKey(&keys[c++], coordKey(p.x), coordKey(p.y), i);
+        }
+        sorted = sortKeys(keys, keys + c, c);
+        for (i = 1; i < c; i++)
+            if (!KEY_LESS(sorted[i-1], sorted[i])) return -3;
+    }
 
-void fillPoly(int n, Point v[], WedgeSequence ws[]) {
+    /* the rings wholly inside, and the rectangle if the others wind around it */
+    cx = ((double)fc->clipMin.x + fc->clipMax.x)/2;
+    cy = ((double)fc->clipMin.y + fc->clipMax.y)/2;
+    for (k = 0, l = 0; k < numbRings; k++) {
+        m = ringOffsets[k+1] - ringOffsets[k];
+        if (m < 3) continue;
+        for (s = 0; s < m && INSIDE_CLIP(fc, v, ringOffsets[k] + s); s++);
+        if (s < m) {
+            for (i = ringOffsets[k]; numbPieces == 0 && i < ringOffsets[k+1]; i++) {
+                j = (i + 1 < ringOffsets[k+1])? i + 1: ringOffsets[k];
+                if ((v[i].y <= cy) == (v[j].y <= cy)) continue;
+                x = v[i].x + (cy - v[i].y) * ((double)v[j].x - v[i].x) / ((double)v[j].y - v[i].y);
+                if (x > cx) l += (v[j].y > v[i].y)? 1: -1;
+            }
+            continue;
+        }
+        for (i = ringOffsets[k], first = numbOut; i < ringOffsets[k+1]; i++)
+            if ((numbOut = addClipped(fc, numbOut, first, v[i].x, v[i].y, i)) < 0) return -1;
+        numbOut = closeClipped(fc, numbOut, first);
+        if (numbOut > first) {
+            if (growBuffer((void**)&fc->clipOffsets, &fc->maxClipOffsets, numbClipped + 2, numbRings + 2,
+                           sizeof(int)))
+                return -1;
+            fc->clipOffsets[++numbClipped] = numbOut;
+        }
+    }
+    if (l != 0) {
+        for (c = 0, first = numbOut; c < 4; c++) {
+            numbOut = addClipped(fc, numbOut, first, (c < 2)? fc->clipMin.x: fc->clipMax.x,
+                                 (c == 1 || c == 2)? fc->clipMax.y: fc->clipMin.y, -1);
+            if (numbOut < 0) return -1;
+        }
+        if (growBuffer((void**)&fc->clipOffsets, &fc->maxClipOffsets, numbClipped + 2, numbRings + 2,
+                       sizeof(int)))
+            return -1;
+        fc->clipOffsets[++numbClipped] = numbOut;
+    }
+    return numbClipped;
+}
+#undef CLIP_TURN
+#undef IN_CLIP
+#undef INSIDE_CLIP
+/*-------------------------------------------------------*/
+static int appendClipped(FillContext *fc, int numbRings, Point v[], const int ringOffsets[])
+{
 /*----------------------------------------------
- * Assumptions:
- * 1. Vertices are given in clockwise order
- * 2. There are no crossing edges.
+ * Decompose the part of the region the rings fill by fc->fillRule (see
+ * appendRings) that is inside the clip rectangle fc->clipMin ..
+ * fc->clipMax.
  *
- * Note:
- * "Up" and "down" assume the y-axis is in "upward" direction.
+ * ORIENTED rings (unless fc->cleanInput is set) are cut to the rectangle
+ * (see clipRings) and decomposed by their joins like any others.
+ *
+ * Otherwise, or if they cross, the rings are clamped to the rectangle:
+ * a point outside moves to the nearest point of its boundary, with a
+ * vertex where an edge crosses the line through a side. That does not
+ * change how often the rings wind around a point inside, and a run of
+ * vertices that end up on the same side becomes one edge along it. So a
+ * ring that only passes by keeps a few vertices, and the sweep of
+ * appendFilled() (by NON_ZERO for ORIENTED rings) only sees the edges
+ * inside the rectangle and the sides: no wedge sequence is made outside
+ * it, and the ones crossing it are cut at its sides.
+ *
+ * Besides a pass over v, the cost is that of the part inside. The vertex
+ * indices of the triangles are the ones they would have with v, with a
+ * point added where a ring is cut. Returns as appendRings().
  */
+    int i, j, k, l, l2, m, first, numbOut = 0,
+        n = ringOffsets[numbRings], /* number of vertices */
+        firstTriangle = fc->numbTriangles;
+    double a, b, lim, dx, dy, t[4], cx[4], cy[4], tt; /* crossings of an edge with the sides' lines */
 
-    int i,j, /* general index */
-        numJoins = 0, /* number of Joins */
-        wsNumb = 0; /* number of wedge sequences */
+    STATS(double phaseStart = statsTime());
 
-    float crossprod, /* cross product at vertex */
-          xmax, xtmp;
+    if (fc->clipMin.x >= fc->clipMax.x || fc->clipMin.y >= fc->clipMax.y) { /* nothing inside */
+        if (reserveWedges(fc, fc->numbWs + 1, 0)) return -1;
+        fc->ws[fc->numbWs].opcode = END;
+        return 0;
+    }
+    if (fc->fillRule == ORIENTED && !fc->cleanInput) {
+        k = clipRings(fc, numbRings, v, ringOffsets);
+        if (k == -1) return -1;
+        if (k >= 0) {
+            STATS(endPhase(fc, CLIP_RINGS, &phaseStart));
+            numbOut = fc->clipOffsets[k];
+            k = appendRings(fc, k, fc->clipPoints, fc->clipOffsets);
+            for (i = 3*firstTriangle; k >= 0 && i < 3*fc->numbTriangles; i++) {
+                j = fc->triangles[i];
+                if (j >= numbOut) fc->triangles[i] = j - numbOut + n;
+                else {
+                    if (fc->clipVertices[j] < 0 &&
+                        (fc->clipVertices[j] = addPoint(fc, n, fc->clipPoints[j].x, fc->clipPoints[j].y)) < 0)
+                        return -1;
+                    fc->triangles[i] = fc->clipVertices[j];
+                }
+            }
+            return k;
+        }
+        numbOut = 0; /* they cross: clamp them */
+    }
 
-    ChainNode *c, /* start of vertex loop */
-              *p, *q, *r, *keepq, /* p,q,r are general ChainNode pointers.*/
-              *qxmax, *qxmin,
-              **sortedJoins, /* array of pointers to Joins */
-              *topOfWindow, *botOfWindow,
-              *p_in, *p_out, *q_in, *q_out;
+    if (growBuffer((void**)&fc->clipOffsets, &fc->maxClipOffsets, numbRings + 1, numbRings + 1,
+                   sizeof(int)))
+        return -1;
+    fc->clipOffsets[0] = 0;
+    for (k = 0; k < numbRings; k++) {
+        first = numbOut;
+        for (i = ringOffsets[k]; i < ringOffsets[k+1]; i++) {
+            j = (i + 1 < ringOffsets[k+1])? i + 1: ringOffsets[k];
+            if ((numbOut = addClipped(fc, numbOut, first, v[i].x, v[i].y, i)) < 0) return -1;
+
+            /* where the edge to v[j] crosses the line through a side
+             * (l = 0, 1: x = clipMin.x, clipMax.x; l = 2, 3: y), by t along it */
+            dx = (double)v[j].x - v[i].x;
+            dy = (double)v[j].y - v[i].y;
+            for (l = 0, m = 0; l < 4; l++) {
+                a = (l < 2)? v[i].x: v[i].y;
+                b = (l < 2)? v[j].x: v[j].y;
+                lim = (l == 0)? fc->clipMin.x: (l == 1)? fc->clipMax.x:
+                      (l == 2)? fc->clipMin.y: fc->clipMax.y;
+                if (!((a < lim && b > lim) || (a > lim && b < lim))) continue;
+                tt = (lim - a)/(b - a);
+                cx[m] = (l < 2)? lim: v[i].x + tt*dx;
+                cy[m] = (l < 2)? v[i].y + tt*dy: lim;
+                for (t[m] = tt, l2 = m++; l2 > 0 && t[l2-1] > t[l2]; l2--) {
+                    tt = t[l2]; t[l2] = t[l2-1]; t[l2-1] = tt;
+                    tt = cx[l2]; cx[l2] = cx[l2-1]; cx[l2-1] = tt;
+                    tt = cy[l2]; cy[l2] = cy[l2-1]; cy[l2-1] = tt;
+                }
+            }
+            for (l = 0; l < m; l++)
+                if ((numbOut = addClipped(fc, numbOut, first, cx[l], cy[l], -1)) < 0) return -1;
+        }
+        fc->clipOffsets[k+1] = numbOut = closeClipped(fc, numbOut, first);
+    }
+    STATS(endPhase(fc, CLIP_RINGS, &phaseStart));
 
-    JoinType joinType; /* current join type (reduces need for indirection) */
+    k = appendFilled(fc, numbRings, fc->clipPoints, fc->clipOffsets, noStrips, 1, NULL, NULL, 0);
+    if (fc->triangulate)
+        for (i = 3*firstTriangle; i < 3*fc->numbTriangles; i++) fc->triangles[i] += n - numbOut;
+    return k;
+}
+/*-------------------------------------------------------*/
+int fillPoly(FillContext *fc, int n, Point v[])
+{
+/* The wedge sequences are left in fc->ws[0 .. fc->numbWs-1], or passed
+ * to fc->sink if set, or the triangles in fc->triangles if fc->triangulate
+ * is set. Returns the number of wedge sequences (or triangles), or -1 if
+ * out of memory or the sink stopped. */
+    fc->numbWs = fc->numbWe = fc->numbSunk = 0;
+    fc->numbTriangles = fc->numbAddedPoints = 0;
+    STATS(memset(&fc->stats, 0, sizeof(fc->stats)));
+    return appendPoly(fc, n, v);
+}
+/*-------------------------------------------------------*/
+int fillRings(FillContext *fc, int numbRings, Point v[], const int ringOffsets[])
+{
+/* As fillPoly(), for the outer rings and holes of appendRings() */
+    fc->numbWs = fc->numbWe = fc->numbSunk = 0;
+    fc->numbTriangles = fc->numbAddedPoints = 0;
+    STATS(memset(&fc->stats, 0, sizeof(fc->stats)));
+    return appendRings(fc, numbRings, v, ringOffsets);
+}
+/*-------------------------------------------------------*/
+static int listStripEdge(FillContext *fc, const Point v[], int i, int j, int s0, int s1)
+{
+/* Add the edge from v[i] to v[j] to the lists of the strips from s0 to
+ * s1 that it goes through. Returns -1 if out of memory. */
+    Coord ylo = (v[i].y < v[j].y)? v[i].y: v[j].y, yhi = (v[i].y < v[j].y)? v[j].y: v[i].y;
+    int s, hi, mid, k;
+
+    if (ylo == yhi) return 0; /* appendFilled() leaves it out */
+    for (s = s0, hi = s1; s < hi; ) { /* first strip that it goes through */
+        mid = (s + hi)/2;
+        if (fc->strips[mid+1] >= yhi) s = mid + 1;
+        else hi = mid;
+    }
+    for (; s <= s1 && fc->strips[s] > ylo; s++) {
+        if ((k = fc->freeStripEdge) >= 0) fc->freeStripEdge = fc->stripEdges[k].next;
+        else {
+            if (growBuffer((void**)&fc->stripEdges, &fc->maxStripEdges, fc->numbStripEdges + 1,
+                           NUMB_WS, sizeof(StripEdge)))
+                return -1;
+            k = fc->numbStripEdges++;
+        }
+        fc->stripEdges[k].edge = i;
+        fc->stripEdges[k].next = fc->stripLists[s];
+        fc->stripLists[s] = k;
+    }
+    return 0;
+}
+/*-------------------------------------------------------*/
+int fillStrips(FillContext *fc, int numbRings, Point v[], const int ringOffsets[], int numbStrips)
+{
+/*----------------------------------------------
+ * As fillRings() by fc->fillRule (see appendFilled), cut into numbStrips
+ * horizontal strips of about the same number of vertices. No wedge
+ * sequence goes from one strip into another, so a strip can be
+ * decomposed again by itself (see moveVertices), from a list kept of the
+ * edges through it. The wedge sequences of strip s are
+ * fc->ws[fc->stripWs[s] .. fc->stripWs[s+1]-1].
+ * fc->sink and fc->triangulate must not be set.
+ * Returns the number of wedge sequences, or -1 if out of memory.
+ */
+    int i, j, k, s, n = ringOffsets[numbRings];
+    JoinKey *keys;
+
+    fc->numbStrips = 0; /* none to decompose again until these are done */
+    if (numbStrips < 1 || n == 0) numbStrips = 1;
+    if (growBuffer((void**)&fc->strips, &fc->maxStrips, numbStrips + 1, numbStrips + 1, sizeof(Coord)) ||
+        growBuffer((void**)&fc->stripWs, &fc->maxStripWs, 2*(numbStrips + 1), 2*(numbStrips + 1),
+                   sizeof(int)) ||
+        growBuffer((void**)&fc->stripLists, &fc->maxStripLists, numbStrips, numbStrips, sizeof(int)) ||
+        growBuffer((void**)&fc->edgeStamps, &fc->maxEdgeStamps, 2*n, 2*n, sizeof(int)) ||
+        growBuffer((void**)&fc->joinKeys, &fc->maxJoinKeys, 2*n, 2*n, sizeof(JoinKey)))
+        return -1;
+
+    /* a strip ends at every (n/numbStrips)-th vertex from the top */
+    keys = fc->joinKeys;
+    for (i = 0; i < n; i++) setKey(&keys[i], (CoordKey)~coordKey(v[i].y), 0, i);
+    keys = sortKeys(keys, keys + n, n);
+    fc->strips[0] = COORD_MAX;
+    for (i = 1; i < numbStrips; i++)
+        fc->strips[i] = v[keys[(int)((long long)i*n/numbStrips)].node].y;
+    fc->strips[numbStrips] = -COORD_MAX;
+
+    /* the edges through each strip */
+    fc->numbStripEdges = fc->moveStamp = 0;
+    fc->freeStripEdge = -1;
+    for (s = 0; s < numbStrips; s++) fc->stripLists[s] = -1;
+    for (k = 0; k < numbRings; k++)
+        for (i = ringOffsets[k]; i < ringOffsets[k+1]; i++) {
+            j = (i + 1 < ringOffsets[k+1])? i + 1: ringOffsets[k];
+            fc->edgeStamps[i] = 0;
+            if (listStripEdge(fc, v, i, j, 0, numbStrips - 1)) return -1;
+        }
 
-    /* Allocate space for initial chain nodes.
-    * This vertices are sequentially stored in a circular list of doubly
-    * linked chain nodes. */
-    c = (ChainNode*) malloc(n * sizeof(ChainNode));
-
-    /* Insert vertex coordinates, delta-y values and create doubly-linked circular list.
-    * Note p->deltay = p->next->y - p->y */
-    for (i = 0, p = c, q = c+1; i < n-1 ; i++, p++, q++) {
-        p->next = q;
-        q->prev = p;
-        p->x = v[i].x;
-        p->y = v[i].y;
-        p->deltay = v[i+1].y - v[i].y;
-    }
-
-    /* close vertex loop */
-    p->next = c;
-    p->x = v[i].x;
-    p->y = v[i].y;
-    p->deltay = v[0].y - v[i].y;
-    c->prev = p;
-
-    /* Make almost horizontal edges exactly horizontal (This eliminates a trapexoid.) */
-    q = c;
-    r = c->next;
-    do {
-        if ((fabs(q->deltay) <= ALMOST_HORIZONTAL) && !(q->deltay == (float)0)) {
-            /* force horizontal */
-            r->y = q->y;
-            r->deltay = r->next->y - r->y;
-            q->deltay = (float)0;
-        }
-        q = r;
-        r = r->next;
-    } while (q != c);
-
-    /* Remove center vertex of three (almost) in-line vertices.
-     *
-     * This is done by looking at the absolute value of the cross product
-     * of the edges incident on the vertex to be (potentially) eliminated.
-     * (This may not be the best way to measure "flatness".)
-     */
-    /* 1. Find any starting vertex (one that will not be eliminated) */
-    for (p=c->prev, q=c, r=c->next; ; p = p->next, r = r->next) {
-        crossprod = q->x * (r->y - p->y) - p->x * q->deltay - r->x * p->deltay;
-        if (fabs(crossprod) > FLATNESS) {
-            c = q;
-            break;
+    fc->numbWs = fc->numbWe = fc->numbSunk = 0;
+    fc->numbTriangles = fc->numbAddedPoints = 0;
+    STATS(memset(&fc->stats, 0, sizeof(fc->stats)));
+    k = appendFilled(fc, numbRings, v, ringOffsets, fc->strips, numbStrips, fc->stripWs, NULL, 0);
+    if (k >= 0) fc->numbStrips = numbStrips;
+    return k;
+}
+/*-------------------------------------------------------*/
+static void reverseItems(char *p, size_t size, int n)
+{
+/* Reverse the order of the n items of size (at most 64) bytes at p */
+    char t[64];
+    char *q = p + (n - 1)*size;
+
+    for (; p < q; p += size, q -= size) {
+        memcpy(t, p, size);
+        memcpy(p, q, size);
+        memcpy(q, t, size);
+    }
+}
+/*-------------------------------------------------------*/
+static void rotateItems(void *p, size_t size, int n, int k)
+{
+/* Move the first k of the n items of size bytes at p to the end */
+    reverseItems((char*)p, size, k);
+    reverseItems((char*)p + k*size, size, n - k);
+    reverseItems((char*)p, size, n);
+}
+/*-------------------------------------------------------*/
+int moveVertices(FillContext *fc, int numbRings, Point v[], const int ringOffsets[],
+                 int numbMoved, const int moved[], const Point to[])
+{
+/*----------------------------------------------
+ * Move v[moved[k]] to to[k], for each k < numbMoved, in the polygon last
+ * decomposed by fillStrips(), and decompose again only the strips that
+ * the edges at the moved vertices go through, before or after the move.
+ * Their new wedge sequences take the place of the old ones in fc->ws,
+ * and fc->stripWs is updated; the strips themselves stay where
+ * fillStrips() put them.
+ *
+ * Only the edges through those strips, from their lists, and the moved
+ * ones are swept, and their lists made again. Besides that, this moves
+ * the wedge sequences below those strips.
+ * Returns the number of wedge sequences, or -1 if out of memory or there
+ * is no decomposition by fillStrips() to change. The output is then left
+ * as it was, but no longer matches v, and this fails until fillStrips()
+ * is called again.
+ */
+    int i, k, r, e, prev, next,
+        j, s0, s1, /* strips decomposed again, first and last */
+        ws0, ws1, we0, we1, /* their old wedge sequences and elements */
+        numbWs = fc->numbWs, numbWe = fc->numbWe, numbTaken = 0, stamp,
+        added, addedWe, *stripWs = fc->stripWs + fc->numbStrips + 1,
+        *taken = fc->edgeStamps + ringOffsets[numbRings]; /* edges swept */
+    Coord ylo = COORD_MAX, yhi = -COORD_MAX;
+    WedgeSequence *s;
+
+    STATS(memset(&fc->stats, 0, sizeof(fc->stats)));
+    if (fc->numbStrips == 0) return -1;
+    if (numbMoved <= 0) return numbWs;
+    stamp = ++fc->moveStamp;
+    for (k = 0; k < numbMoved; k++) {
+        i = moved[k];
+        r = ringOf(ringOffsets, numbRings, i);
+        prev = (i > ringOffsets[r])? i - 1: ringOffsets[r+1] - 1;
+        next = (i + 1 < ringOffsets[r+1])? i + 1: ringOffsets[r];
+        if (v[prev].y < ylo) ylo = v[prev].y;
+        if (v[prev].y > yhi) yhi = v[prev].y;
+        if (v[next].y < ylo) ylo = v[next].y;
+        if (v[next].y > yhi) yhi = v[next].y;
+        if (v[i].y < ylo) ylo = v[i].y;
+        if (v[i].y > yhi) yhi = v[i].y;
+        if (to[k].y < ylo) ylo = to[k].y;
+        if (to[k].y > yhi) yhi = to[k].y;
+        v[i] = to[k];
+        if (fc->edgeStamps[prev] != stamp) taken[numbTaken++] = prev;
+        fc->edgeStamps[prev] = stamp;
+        if (fc->edgeStamps[i] != stamp) taken[numbTaken++] = i;
+        fc->edgeStamps[i] = stamp;
+    }
+    for (s0 = 0; s0 < fc->numbStrips - 1 && fc->strips[s0+1] >= yhi; s0++) {}
+    for (s1 = s0; s1 < fc->numbStrips - 1 && fc->strips[s1+1] > ylo; s1++) {}
+
+    /* The edges through those strips are taken too, and listed again.
+     * The moved ones were and are only in those strips. */
+    for (j = s0; j <= s1; j++) {
+        for (k = fc->stripLists[j]; k >= 0; k = next) {
+            e = fc->stripEdges[k].edge;
+            if (fc->edgeStamps[e] != stamp) taken[numbTaken++] = e;
+            fc->edgeStamps[e] = stamp;
+            next = fc->stripEdges[k].next;
+            fc->stripEdges[k].next = fc->freeStripEdge;
+            fc->freeStripEdge = k;
+        }
+        fc->stripLists[j] = -1;
+    }
+    for (k = 0; k < numbTaken; k++) {
+        i = taken[k];
+        r = ringOf(ringOffsets, numbRings, i);
+        next = (i + 1 < ringOffsets[r+1])? i + 1: ringOffsets[r];
+        if (listStripEdge(fc, v, i, next, s0, s1)) {
+            fc->numbStrips = 0;
+            return -1;
+        }
+    }
+
+    ws0 = fc->stripWs[s0];
+    ws1 = fc->stripWs[s1+1];
+    we0 = (ws0 < numbWs)? fc->ws[ws0].firstWe: numbWe;
+    we1 = (ws1 < numbWs)? fc->ws[ws1].firstWe: numbWe;
+    added = appendFilled(fc, numbRings, v, ringOffsets, fc->strips + s0, s1 - s0 + 1, stripWs,
+                         taken, numbTaken);
+    if (added < 0) {
+        fc->numbWs = numbWs;
+        fc->numbWe = numbWe;
+        fc->ws[numbWs].opcode = END;
+        fc->numbStrips = 0;
+        return -1;
+    }
+    addedWe = fc->numbWe - numbWe;
+
+    /* the new output goes in front of the old one below it, then the
+     * old output of the strips is dropped */
+    rotateItems(fc->ws + ws1, sizeof(WedgeSequence), numbWs - ws1 + added, numbWs - ws1);
+    memmove(fc->ws + ws0, fc->ws + ws1, (numbWs - ws1 + added) * sizeof(WedgeSequence));
+    rotateItems(fc->we + we1, sizeof(WedgeElement), numbWe - we1 + addedWe, numbWe - we1);
+    memmove(fc->we + we0, fc->we + we1, (numbWe - we1 + addedWe) * sizeof(WedgeElement));
+    for (s = fc->ws + ws0, i = 0; i < added; i++, s++) s->firstWe += we0 - numbWe;
+    for (; i < added + numbWs - ws1; i++, s++) s->firstWe += we0 + addedWe - we1;
+    fc->numbWs = numbWs - (ws1 - ws0) + added;
+    fc->numbWe = numbWe - (we1 - we0) + addedWe;
+    fc->ws[fc->numbWs].opcode = END;
+
+    for (k = fc->numbStrips; k > s1 + 1; k--) fc->stripWs[k] += added - (ws1 - ws0);
+    for (k = s0; k <= s1 + 1; k++) fc->stripWs[k] = ws0 + stripWs[k - s0];
+    return fc->numbWs;
+}
+/*-------------------------------------------------------*/
+static int emitPiece(FillContext *fc, NodeRef topOfWindow)
+{
+/* Output the monotone polygon below topOfWindow in the mode set in fc */
+#ifdef FILL_STATS
+    double start = statsTime(), t;
+    int status = fc->triangulate? triangulateMonotone(fc, topOfWindow): makeWedgeSequence(fc, topOfWindow);
+
+    t = statsTime() - start;
+    fc->stats.seconds[EMIT_PIECES] += t;
+    fc->stats.seconds[PROCESS_JOINS] -= t; /* which it is called from */
+    fc->stats.pieces++;
+    return status;
+#else
+    if (fc->triangulate) return triangulateMonotone(fc, topOfWindow);
+    return makeWedgeSequence(fc, topOfWindow);
+#endif
+}
+/*-------------------------------------------------------*/
+int appendPoly(FillContext *fc, int n, Point v[])
+{
+/* Decompose the polygon v[0 .. n-1], given in clockwise order (see appendRings) */
+    int ringOffsets[2];
+
+    ringOffsets[0] = 0;
+    ringOffsets[1] = n;
+    return appendRings(fc, 1, v, ringOffsets);
+}
+/*-------------------------------------------------------*/
+static inline int isFlat(Cross crossprod, Coord dx, Coord dy, double tolerance)
+{
+/* A vertex with cross product crossprod of its edges is in line with its
+ * neighbours, (dx, dy) apart, if it is no more than tolerance from the
+ * line through them */
+    return crossprod == 0 || (tolerance > 0 &&
+        (double)crossprod * crossprod <= tolerance * tolerance * ((double)dx * dx + (double)dy * dy));
+}
+/*-------------------------------------------------------*/
+static int narrowSleeve(double sleeve[4], double ux, double uy, double dx, double dy, double tolerance)
+{
+/* sleeve[0 .. 3] are the directions, clockwise first, bounding the ones
+ * from the last vertex kept that pass within tolerance of the vertices
+ * dropped since; (0, 0) first for all directions. Narrow it to the ones
+ * that also pass that close to the next vertex, (ux, uy) away, if the
+ * direction (dx, dy) of the vertex after that is still in it. Returns
+ * whether it is. */
+    double lox = sleeve[0], loy = sleeve[1], hix = sleeve[2], hiy = sleeve[3],
+           len = sqrt(ux * ux + uy * uy), sn, cs;
+
+    if (len > tolerance) {
+        sn = tolerance / len;
+        cs = sqrt(1 - sn * sn);
+        ux /= len;
+        uy /= len;
+        if ((lox == 0 && loy == 0) || lox * (uy*cs - ux*sn) - loy * (ux*cs + uy*sn) > 0) {
+            lox = ux*cs + uy*sn;
+            loy = uy*cs - ux*sn;
         }
-        q = r;
-        if (q == c) { // This means all the points in the polygon are collinear.
-            // Thus it boils down polygon with two vertices.
-            ws[0].opcode = !WEDGE_SEQ;
-            return;
+        if ((hix == 0 && hiy == 0) || hix * (uy*cs + ux*sn) - hiy * (ux*cs - uy*sn) < 0) {
+            hix = ux*cs - uy*sn;
+            hiy = uy*cs + ux*sn;
         }
     }
-    /* 2. Eliminate center vertex of all in-line triples */
-    p=c->prev;
-    q=c;
-    r=c->next;
-    i = 0;
+    if (!(lox == 0 && loy == 0) &&
+        (lox * dy - loy * dx < 0 || dx * hiy - dy * hix < 0 || (lox + hix) * dx + (loy + hiy) * dy <= 0))
+        return 0;
+    sleeve[0] = lox;
+    sleeve[1] = loy;
+    sleeve[2] = hix;
+    sleeve[3] = hiy;
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int ringStep(const Point v[], int n, int a, int d)
+{
+/* The vertex after v[a] going round the ring v[0 .. n-1] forward (d = 1)
+ * or back (d = -1), passing over the ones in line with their neighbours
+ * as appendRings() removes them */
+    int b, c = a;
+    Cross crossprod;
+    const Point *p, *q, *r;
+
     do {
-        /* cross product of edges on either side of current point, q */
-        crossprod = q->x * (r->y - p->y) - p->x * q->deltay - r->x * p->deltay;
-        if (fabs(crossprod) <= FLATNESS) {
-            p->next = r;
-            r->prev = p;
-            p->deltay = r->y - p->y;
+        b = c;
+        c += d;
+        if (c == n) c = 0;
+        else if (c < 0) c = n - 1;
+        if (b == a) continue;
+        p = v + ((d > 0)? a: c);
+        q = v + b;
+        r = v + ((d > 0)? c: a);
+        crossprod = (Cross)q->x * (r->y - p->y) - (Cross)p->x * (r->y - q->y) - (Cross)r->x * (q->y - p->y);
+        if (crossprod != 0) return b;
+    } while (c != a);
+    return c;
+}
+/*-------------------------------------------------------*/
+static void stepChain(FillContext *fc, Chain *c)
+{
+/* Move c down its side to the next vertex */
+    USES_NODES(fc);
+    c->node = c->nextNode;
+    c->i = c->ni;
+    c->x = c->nx;
+    c->y = c->ny;
+    if (c->v) {
+        c->ni = ringStep(c->v, c->n, c->i, c->d);
+        c->nx = c->v[c->ni].x;
+        c->ny = c->v[c->ni].y;
+    } else {
+        c->nextNode = (c->d > 0)? NEXT(c->node): PREV(c->node);
+        c->nx = X(c->nextNode);
+        c->ny = (c->k < c->numbYs)? c->ys[c->k]: Y(c->nextNode);
+        c->k++;
+    }
+}
+/*-------------------------------------------------------*/
+static void startChain(FillContext *fc, Chain *c, NodeRef p, const Point v[], int n, int i, int d,
+                       const Coord ys[], int numbYs)
+{
+/* Start c at node p of a vertex loop, or at v[i] of the ring v[0 .. n-1]
+ * if v is set, going down by NEXT or forward if d > 0, by PREV or back
+ * if d < 0, with the first numbYs vertices after p at ys (on a vertex
+ * loop) */
+    USES_NODES(fc);
+    c->v = v;
+    c->n = n;
+    c->d = d;
+    c->nextNode = v? NIL: p;
+    c->ni = v? i: 0;
+    c->nx = v? v[i].x: X(p);
+    c->ny = v? v[i].y: Y(p);
+    c->ys = ys;
+    c->numbYs = numbYs;
+    c->k = 0;
+    stepChain(fc, c);
+}
+/* chains l and r are at the same vertex */
+#define SAME_VERTEX(l, r) ((l)->node == (r)->node && (l)->i == (r)->i)
+/*-------------------------------------------------------*/
+static int emitWedges(FillContext *fc, Chain *p, Chain *q, Coord xmin, Coord xmax, Coord ybot)
+{
+/* Append the wedge sequence of the monotone piece with left side p and
+ * right side q, both at its top, between xmin and xmax and down to ybot,
+ * to the output of fc, or pass it to fc->sink. Where q starts with a
+ * horizontal edge, the top is its left end.
+ * Returns -1 if out of memory or the sink stopped. */
+    Coord prevy, old;
+    int i = 0; /* wedge element index */
+    WedgeSequence *s;
+    WedgeElement *we;
+
+    /* room for this sequence, the END opcode and the first wedge */
+    if (reserveWedges(fc, fc->numbWs + 2, fc->numbWe + 1)) return -1;
+    s = fc->ws + fc->numbWs;
+    we = fc->we + fc->numbWe;
+
+    s->opcode = WEDGE_SEQ;
+    s->x = xmin;
+    s->y = p->y;
+    s->pwidth = xmax - xmin;
+    s->pht = p->y - ybot;
+    we[0].wedgeType = BOTH;
+    we[0].lCorr = p->x - xmin;
+    if (q->ny == q->y) {
+        stepChain(fc, q);
+        we[0].rCorr = q->x - xmin;
+    } else
+        we[0].rCorr = we[0].lCorr;
+    we[0].lSlope = (Real)(p->x - p->nx)/(p->y - p->ny);
+    we[0].rSlope = -(Real)(q->x - q->nx)/(q->ny - q->y);
+    for (prevy = p->y, stepChain(fc, q), stepChain(fc, p); !SAME_VERTEX(p, q); ) {
+        i++;
+        if (fc->numbWe + i >= fc->maxWe) {
+            if (reserveWedges(fc, 0, fc->numbWe + i + 1)) return -1;
+            we = fc->we + fc->numbWe;
+        }
+        if (p->y < q->y) {
+            we[i].wedgeType = RIGHT;
+            we[i-1].height = prevy - q->y;
+            prevy = q->y;
+            if (q->ny == q->y) {
+                old = q->x;
+                stepChain(fc, q);
+                we[i].rCorr = q->x - old;
+            } else
+                we[i].rCorr = (Coord)0;
+            we[i].rSlope = -(Real)(q->x - q->nx)/(q->ny - q->y);
+            stepChain(fc, q);
+        } else if (p->y > q->y) {
+            we[i].wedgeType = LEFT;
+            we[i-1].height = prevy - p->y;
+            prevy = p->y;
+            if (p->ny == p->y) {
+                old = p->x;
+                stepChain(fc, p);
+                we[i].lCorr = p->x - old;
+            } else
+                we[i].lCorr = (Coord)0;
+            we[i].lSlope = (Real)(p->x - p->nx)/(p->y - p->ny);
+            stepChain(fc, p);
         } else {
-            q->joinType = (crossprod > 0)? POSCROSSPROD: 0;
-            p = q;
+            we[i-1].height = prevy - p->y; /*pick left vertex height*/
+            if (q->ny == q->y) {
+                old = q->x;
+                stepChain(fc, q);
+                if (SAME_VERTEX(p, q)) { /* if bottom of sequence is horizontal */
+                    i--;
+                    break;
+                }
+                we[i].rCorr = q->x - old;
+            } else
+                we[i].rCorr = (Coord)0;
+            we[i].wedgeType = BOTH;
+            prevy = p->y;
+            we[i].rSlope = -(Real)(q->x - q->nx)/(q->ny - q->y);
+            stepChain(fc, q);
+            if (p->ny == p->y) {
+                old = p->x;
+                stepChain(fc, p);
+                we[i].lCorr = p->x - old;
+            } else
+                we[i].lCorr = (Coord)0;
+            we[i].lSlope = (Real)(p->x - p->nx)/(p->y - p->ny);
+            stepChain(fc, p);
+        }
+    }
+    we[i].height = prevy - ybot;
+    we[i].wedgeType = (WedgeType) (we[i].wedgeType | LAST_WE);
+
+    s->firstWe = fc->numbWe;
+    s->numbWe = i + 1;
+#ifdef FILL_STATS
+    fc->stats.wedges += i + 1;
+    if (i + 1 > fc->stats.maxWedges) fc->stats.maxWedges = i + 1;
+#endif
+    if (fc->sink) {
+        fc->numbSunk++;
+        return fc->sink(fc->sinkData, s, we)? -1: 0;
+    }
+    fc->numbWe += i + 1;
+    fc->numbWs++;
+    return 0;
+}
+/*-------------------------------------------------------*/
+static int appendMonotone(FillContext *fc, int n, const Point v[])
+{
+/*----------------------------------------------
+ * If the clockwise ring v[0 .. n-1] is y-monotone, that is if the sign
+ * of its nonzero deltay changes just twice going round it, output it as
+ * the one wedge sequence makeWedgeSequence() would make of it. It has
+ * no joins to sort or windows to find, so this takes one pass over v[]
+ * to tell, and one of emitWedges() down its two chains, read off v[]
+ * instead of a vertex loop.
+ * Returns 1 if it was output, 0 if not (the ring is not y-monotone, not
+ * clockwise, or has a spike at the top or bottom), or -1 if out of
+ * memory or the sink stopped.
+ */
+    Coord dy, xmin, xmax, ymin, ymax;
+    Cross crossprod;
+    double area = 0;
+    int i, j, p, q, sign = 0, firstSign = 0, changes = 0, top = 0, bot = 0;
+    Chain left, right;
+    STATS(double phaseStart = statsTime());
+
+    if (n < 3) return 0;
+    xmin = xmax = v[0].x;
+    ymin = ymax = v[0].y;
+    for (i = 0; i < n; i++) {
+        j = (i + 1 < n)? i + 1: 0;
+        dy = v[j].y - v[i].y;
+        if (dy != (Coord)0) {
+            if (!firstSign) firstSign = (dy > 0)? 1: -1;
+            else if ((dy > 0) != (sign > 0)) changes++;
+            sign = (dy > 0)? 1: -1;
+        }
+        area += (double)v[i].x * v[j].y - (double)v[j].x * v[i].y;
+        if (v[i].x < xmin) xmin = v[i].x;
+        if (v[i].x > xmax) xmax = v[i].x;
+        if (v[i].y < ymin) {
+            ymin = v[i].y;
+            bot = i;
+        }
+        if (v[i].y > ymax) {
+            ymax = v[i].y;
+            top = i;
+        }
+    }
+    if (firstSign != sign) changes++;
+    if (changes != 2 || !(area < 0)) return 0;
+
+    /* the top and bottom are the left ends of horizontal edges there, and
+     * must be convex */
+    while (v[(top > 0)? top - 1: n - 1].y == ymax) top = (top > 0)? top - 1: n - 1;
+    while (v[(bot + 1 < n)? bot + 1: 0].y == ymin) bot = (bot + 1 < n)? bot + 1: 0;
+    for (i = 0; i < 2; i++) {
+        j = i? bot: top;
+        p = ringStep(v, n, j, -1);
+        q = ringStep(v, n, j, 1);
+        crossprod = (Cross)v[j].x * (v[q].y - v[p].y) - (Cross)v[p].x * (v[q].y - v[j].y) -
+                    (Cross)v[q].x * (v[j].y - v[p].y);
+        if (!(crossprod < 0)) return 0;
+    }
+    STATS(endPhase(fc, BUILD_RINGS, &phaseStart));
+
+    startChain(fc, &left, NIL, v, n, top, -1, NULL, 0);
+    startChain(fc, &right, NIL, v, n, top, 1, NULL, 0);
+    if (emitWedges(fc, &left, &right, xmin, xmax, ymin)) {
+        fc->ws[fc->numbWs].opcode = END;
+        return -1;
+    }
+#ifdef FILL_STATS
+    fc->stats.pieces++;
+    fc->stats.monotone++;
+    endPhase(fc, EMIT_PIECES, &phaseStart);
+#endif
+    fc->ws[fc->numbWs].opcode = END;
+    return 1;
+}
+/*-------------------------------------------------------*/
+static int simplifyRings(FillContext *fc, int numbRings, const Point v[], const int ringOffsets[])
+{
+/*----------------------------------------------
+ * Copy the rings v to fc->simplePoints (ring offsets fc->simpleOffsets),
+ * moving or dropping vertices by up to fc->tolerance:
+ *
+ * 1. An edge that rises or falls by no more is made horizontal, by moving
+ *    its end to the height of its start, going round the ring once.
+ * 2. Starting at a vertex further from the line through its neighbours,
+ *    a vertex is dropped while the line from the last one kept to the one
+ *    after it passes close enough to it and all dropped since (see
+ *    narrowSleeve). Vertices exactly in line are always dropped.
+ *
+ * A ring left with less than three vertices goes. The rings may touch or
+ * cross where they came closer than the tolerance. Returns the number of
+ * vertices moved or dropped (but for ones exactly in line), or -1 if out
+ * of memory.
+ */
+    int i, j, k, m, p, q, r, start, bent, numbOut = 0, moved = 0, n = ringOffsets[numbRings];
+    double tolerance = TOLERANCE(fc), sleeve[4];
+    Cross crossprod;
+    Point *o, *s;
+
+    /* each ring is snapped into s, after the ones done */
+    if (growBuffer((void**)&fc->simplePoints, &fc->maxSimplePoints, 2*n, 2*n, sizeof(Point)) ||
+        growBuffer((void**)&fc->simpleOffsets, &fc->maxSimpleOffsets, numbRings + 1, numbRings + 1,
+                   sizeof(int)))
+        return -1;
+    o = fc->simplePoints;
+    s = o + n;
+    fc->simpleOffsets[0] = 0;
+    for (k = 0; k < numbRings; k++) {
+        m = ringOffsets[k+1] - ringOffsets[k];
+        memcpy(s, v + ringOffsets[k], m * sizeof(Point));
+        for (i = 0; i < m; i++) {
+            j = (i + 1 < m)? i + 1: 0;
+            if (fabs(s[j].y - s[i].y) <= tolerance && !(s[j].y == s[i].y)) {
+                s[j].y = s[i].y;
+                moved++;
+                STATS(fc->stats.snapped++);
+            }
         }
-        q = r;
-        r = r->next;
-        i++;
-    } while (q != c);
 
-    /* Find beginning of next down-chain */
+#define CROSS(a, b, c) ((Cross)s[b].x * (s[c].y - s[a].y) - (Cross)s[a].x * (s[c].y - s[b].y) - \
+                        (Cross)s[c].x * (s[b].y - s[a].y))
+        for (q = 0, start = bent = -1; q < m && start < 0; q++) {
+            p = (q > 0)? q - 1: m - 1;
+            r = (q + 1 < m)? q + 1: 0;
+            crossprod = CROSS(p, q, r);
+            if (!isFlat(crossprod, s[r].x - s[p].x, s[r].y - s[p].y, tolerance)) start = q;
+            else if (crossprod != 0 && bent < 0) bent = q;
+        }
+        if (start < 0) start = bent;
+        if (start >= 0) {
+            o[numbOut++] = s[start];
+            sleeve[0] = sleeve[1] = sleeve[2] = sleeve[3] = 0;
+            for (i = 1, p = start; i < m; i++) {
+                q = (start + i) % m;
+                r = (q + 1 < m)? q + 1: 0;
+                crossprod = CROSS(p, q, r);
+                if (narrowSleeve(sleeve, (double)s[q].x - s[p].x, (double)s[q].y - s[p].y,
+                                 (double)s[r].x - s[p].x, (double)s[r].y - s[p].y, tolerance) ||
+                    crossprod == 0) {
+                    if (crossprod != 0) moved++;
+                    STATS(if (crossprod != 0) fc->stats.flattened++);
+                    continue;
+                }
+                o[numbOut++] = s[q];
+                p = q;
+                sleeve[0] = sleeve[1] = sleeve[2] = sleeve[3] = 0;
+            }
+        }
+#undef CROSS
+        if (numbOut - fc->simpleOffsets[k] < 3) numbOut = fc->simpleOffsets[k];
+        fc->simpleOffsets[k+1] = numbOut;
+    }
+    return moved;
+}
+/*-------------------------------------------------------*/
+static int decomposeRings(FillContext *fc, int numbRings, Point v[], const int ringOffsets[], int check)
+{
+/* appendRings() once the rings are inside the clip rectangle and
+ * simplified, for ORIENTED rings. If check is set, they are checked for
+ * edges that cross or touch, as with fc->cleanInput (see cleanRings),
+ * but keep their orientation. */
+
+    int i, k, /* general index, ring index */
+        n = ringOffsets[numbRings], /* number of vertices */
+        numbNodes, /* vertices and the nodes that link in holes */
+        numbLoops = 0, numbHoles = 0, /* number of outer rings, holes */
+        numJoins = 0, /* number of Joins */
+        loopJoins, numbPeaks, /* joins before the current loop, its peaks */
+        numbSplits, /* number of split joins */
+        first = fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk, /* first output of this polygon */
+        status = 0; /* set to -1 if output could not be stored */
+
+    Cross crossprod; /* cross product at vertex */
+    double area; /* twice the signed area of a ring */
+
+    NodeRef c, /* start of vertex loop */
+            p, q, r, keepq, /* p,q,r are general ChainNode references.*/
+            qxmax, qxmin,
+            *sortedJoins, /* array of references to Joins */
+            topOfWindow, botOfWindow,
+            p_in, p_out, q_in, q_out,
+            addedNode; /* next free node in fc->addedNodes */
 
-    /* 1. find first actual rising edge */
-    for (q = c; q->deltay <= 0; q = q->next) {};
+    JoinType joinType; /* current join type (reduces need for indirection) */
 
-    /* 2. find end of this up-chain (i.e., beginning of down-chain.) */
-    for (q = q->next; q->deltay >= 0; q = q->next) {};
+    TreapNode *pieces = NULL, /* edge pieces not starting at a vertex (see findPiece) */
+              *piece = NULL; /* next free treap node for a piece */
+
+    STATS(double phaseStart = statsTime()); /* start of the current phase */
+
+    if (numbRings == 1 && !fc->triangulate && !fc->cleanInput && !check &&
+        (status = appendMonotone(fc, n, v)) != 0)
+        return status;
+    if (reserveWedges(fc, fc->numbWs + 1, 0)) return -1;
+
+    /* Allocate space for initial chain nodes, and three more per ring in
+    * case it is a hole. The vertices of each ring are sequentially stored
+    * in a circular list of doubly linked chain nodes. */
+    if (reserveNodes(fc, n + 3*numbRings, 0) ||
+        growBuffer((void**)&fc->rings, &fc->maxRings, numbRings, numbRings, sizeof(NodeRef)))
+        return -1;
+    fc->numbVertices = n;
+
+    for (k = 0; k < numbRings; k++) {
+        if (ringOffsets[k+1] - ringOffsets[k] < 3) continue;
+        c = VERTEX(ringOffsets[k]);
+
+        /* Insert vertex coordinates, delta-y values and create doubly-linked circular list.
+        * Note p->deltay = p->next->y - p->y */
+        area = 0;
+        for (i = ringOffsets[k], p = c, q = c+1; i < ringOffsets[k+1]-1 ; i++, p++, q++) {
+            NEXT(p) = q;
+            PREV(q) = p;
+            X(p) = v[i].x;
+            Y(p) = v[i].y;
+            DELTAY(p) = v[i+1].y - v[i].y;
+            PREVJOIN(p) = NIL;
+            area += (double)v[i].x * v[i+1].y - (double)v[i+1].x * v[i].y;
+        }
 
-    /* Note that a horizontal edge at the top of a chain is considered to belong to the down-chain */
-    if ((q->prev->deltay == 0) && !(q->joinType & POSCROSSPROD)) q = q->prev;
-    /* q now points to a peak join (left of horizontal edge) */
+        /* close vertex loop */
+        NEXT(p) = c;
+        X(p) = v[i].x;
+        Y(p) = v[i].y;
+        DELTAY(p) = v[ringOffsets[k]].y - v[i].y;
+        PREVJOIN(p) = NIL;
+        PREV(c) = p;
+        area += (double)v[i].x * v[ringOffsets[k]].y - (double)v[ringOffsets[k]].x * v[i].y;
+        STATS(endPhase(fc, BUILD_RINGS, &phaseStart));
+
+
+        if (fc->cleanInput) {
+            c = removeRepeats(fc, c);
+            STATS(endPhase(fc, CLEAN_RINGS, &phaseStart));
+            if (c == NIL) continue;
+        }
 
-    /* Collect all chains and joins */
-    keepq = q;
-    do {
-        /* Find down-chain, and right-most node of down-chain */
-        for (p = qxmax = q, q = p->next; q->deltay <=0; q = q->next) {
-            if (q->x >= qxmax->x) qxmax = q;
+        if (area < 0) fc->rings[numbLoops++] = c;
+        else if (area > 0) /* a hole is kept by its top (leftmost) vertex, from the back */
+            fc->rings[numbRings - ++numbHoles] = topVertex(fc, c);
+    }
+    memmove(fc->rings + numbLoops, fc->rings + numbRings - numbHoles, numbHoles * sizeof(NodeRef));
+    if (fc->cleanInput || check) {
+        if ((status = cleanRings(fc, n, &numbLoops, &numbHoles, fc->cleanInput)) < 0) return status;
+        STATS(endPhase(fc, CLEAN_RINGS, &phaseStart));
+    }
+    numbNodes = n + 3*numbHoles;
+    if (numbHoles && linkHoles(fc, n, numbLoops, numbHoles)) return -1;
+    STATS(endPhase(fc, LINK_HOLES, &phaseStart));
+
+    for (k = 0, i = 0; k < numbLoops; k++) {
+        c = fc->rings[k];
+
+        /* Remove center vertex of three in-line vertices.
+         *
+         * This is done by looking at the cross product of the edges
+         * incident on the vertex to be (potentially) eliminated. (Almost
+         * in-line ones are removed within fc->tolerance by simplifyRings.)
+         */
+        /* 1. Find any starting vertex (one that will not be eliminated) */
+        for (p=PREV(c), q=c, r=NEXT(c); ; p = NEXT(p), r = NEXT(r)) {
+            crossprod = (Cross)X(q) * (Y(r) - Y(p)) - (Cross)X(p) * DELTAY(q) - (Cross)X(r) * DELTAY(p);
+            if (crossprod != 0) {
+                c = q;
+                break;
+            }
+            q = r;
+            if (q == c) { // This means all the points in the ring are collinear.
+                c = NIL; // Thus it boils down to a ring with two vertices.
+                break;
+            }
         }
+        if (c == NIL) {
+            STATS(endPhase(fc, REMOVE_COLLINEAR, &phaseStart));
+            continue;
+        }
+
+        /* 2. Eliminate center vertex of all in-line triples */
+        p=PREV(c);
+        q=c;
+        r=NEXT(c);
+        do {
+            /* cross product of edges on either side of current point, q */
+            crossprod = (Cross)X(q) * (Y(r) - Y(p)) - (Cross)X(p) * DELTAY(q) - (Cross)X(r) * DELTAY(p);
+            if (crossprod == 0) {
+                NEXT(p) = r;
+                PREV(r) = p;
+                DELTAY(p) = Y(r) - Y(p);
+            } else {
+                JOINTYPE(q) = (crossprod > 0)? POSCROSSPROD: 0;
+                p = q;
+            }
+            q = r;
+            r = NEXT(r);
+        } while (q != c);
+        STATS(endPhase(fc, REMOVE_COLLINEAR, &phaseStart));
+        if (NEXT(NEXT(c)) == c) continue; /* a sliver that rounding made collinear after all */
+
+        /* Find beginning of next down-chain */
+
+        /* 1. find first actual rising edge */
+        for (q = c; DELTAY(q) <= 0; q = NEXT(q)) {};
+
+        /* 2. find end of this up-chain (i.e., beginning of down-chain.) */
+        for (q = NEXT(q); DELTAY(q) >= 0; q = NEXT(q)) {};
+
+        /* Note that a horizontal edge at the top of a chain is considered to belong to the down-chain */
+        if ((DELTAY(PREV(q)) == 0) && !(JOINTYPE(q) & POSCROSSPROD)) q = PREV(q);
+        /* q now points to a peak join (left of horizontal edge) */
+
+        /* Collect all chains and joins */
+        keepq = q;
+        loopJoins = numJoins;
+        numbPeaks = 0;
+        do {
+            /* Find down-chain, and right-most node of down-chain */
+            for (p = qxmax = q, q = NEXT(p); DELTAY(q) <=0; q = NEXT(q)) {
+                if (X(q) >= X(qxmax)) qxmax = q;
+            }
+
+            if (DELTAY(PREV(q)) == 0) {
+                if (JOINTYPE(q) & POSCROSSPROD) q = PREV(q);
 
-        if (q->prev->deltay == 0) {
-            if (q->joinType & POSCROSSPROD) q = q->prev;
+            } else if (X(q) >= X(qxmax)) qxmax = q;
 
-        } else if (q->x >= qxmax->x) qxmax = q;
+            /* vertical down-chains are default DOWNTORIGHT.
+            * p now points to top of chain (left of horizontal edge.)
+            * q now points to bottom of chain (left of horizontal edge),
+            * qxmax points to node with rightmost vertex */
 
-        /* vertical down-chains are default DOWNTORIGHT.
-        * p now points to top of chain (left of horizontal edge.)
-        * q now points to bottom of chain (left of horizontal edge),
-        * qxmax points to node with rightmost vertex */
+            if ( (qxmax != p) && (qxmax != q) ) {
+                /* Create a DCUSP join, and set join links */
+                NEXTJOIN(p) = qxmax;
+                PREVJOIN(qxmax) = p;
+                NEXTJOIN(qxmax) = q;
+                PREVJOIN(q) = qxmax;
+                JOINTYPE(p) |= DOWNTORIGHT;
+                numJoins++;
+                JOINTYPE(qxmax) = DCUSP; /* note that POSCROSSPROD is set to false*/
 
-        if ( (qxmax != p) && (qxmax != q) ) {
-            /* Create a DCUSP join, and set join links */
-            p->nextJoin = qxmax;
-            qxmax->prevJoin = p;
-            qxmax->nextJoin = q;
-            q->prevJoin = qxmax;
-            p->joinType |= DOWNTORIGHT;
+            } else {
+                NEXTJOIN(p) = q;
+                PREVJOIN(q) = p;
+                if (qxmax == q) {
+                    JOINTYPE(p) |= DOWNTORIGHT;
+                    if (JOINTYPE(q) & POSCROSSPROD)
+                        JOINTYPE(q) |= DOWNTORIGHT;
+                    else
+                        JOINTYPE(q) = DCUSP;/* note that POSCROSSPROD is set to false*/
+                } else /* qxmax == p */
+                    if ( !(JOINTYPE(p) & POSCROSSPROD) )
+                        JOINTYPE(p) = DCUSP;/* note that POSCROSSPROD is set to false*/
+            }
             numJoins++;
-            qxmax->joinType = DCUSP; /* note that POSCROSSPROD is set to false*/
+            numbPeaks++;
+            JOINTYPE(p) |= PEAK;
 
-        } else {
-            p->nextJoin = q;
-            q->prevJoin = p;
-            if (qxmax == q) {
-                p->joinType |= DOWNTORIGHT;
-                if (q->joinType & POSCROSSPROD)
-                    q->joinType |= DOWNTORIGHT;
-                else
-                    q->joinType = DCUSP;/* note that POSCROSSPROD is set to false*/
-            } else /* qxmax == p */
-                if ( !(p->joinType & POSCROSSPROD) )
-                    p->joinType = DCUSP;/* note that POSCROSSPROD is set to false*/
-        }
-        numJoins++;
-        p->joinType |= PEAK;
-
-        /* handle up-chain */
-        numJoins++;
-        p = q; /* p is beginning of up-chain */
-
-        for (qxmin = p, q = q->next; q->deltay >= 0; q = q->next) {
-            if (q->x < qxmin->x) qxmin = q;
-        }
-        if (q->prev->deltay == 0) {
-            if (!(q->joinType & POSCROSSPROD)) q = q->prev;
-
-        } else if (q->x < qxmin->x) qxmin = q;
-
-        if ((qxmin != p) && (qxmin != q)) {
-            p->nextJoin = qxmin;
-            qxmin->prevJoin = p;
-            qxmin->nextJoin = q;
-            q->prevJoin = qxmin;
-            qxmin->joinType = UCUSP;
+            /* handle up-chain */
             numJoins++;
+            p = q; /* p is beginning of up-chain */
 
-        } else {
-            p->nextJoin = q;
-            q->prevJoin = p;
+            for (qxmin = p, q = NEXT(q); DELTAY(q) >= 0; q = NEXT(q)) {
+                if (X(q) < X(qxmin)) qxmin = q;
+            }
+            if (DELTAY(PREV(q)) == 0) {
+                if (!(JOINTYPE(q) & POSCROSSPROD)) q = PREV(q);
+
+            } else if (X(q) < X(qxmin)) qxmin = q;
+
+            if ((qxmin != p) && (qxmin != q)) {
+                NEXTJOIN(p) = qxmin;
+                PREVJOIN(qxmin) = p;
+                NEXTJOIN(qxmin) = q;
+                PREVJOIN(q) = qxmin;
+                JOINTYPE(qxmin) = UCUSP;
+                numJoins++;
+
+            } else {
+                NEXTJOIN(p) = q;
+                PREVJOIN(q) = p;
+            }
+
+        } while (q != keepq);
+        STATS(endPhase(fc, COLLECT_JOINS, &phaseStart));
+
+        /* A loop with one peak is y-monotone, and is a monotone piece by
+         * itself: its joins need not be sorted or processed. p is its
+         * bottom. */
+        if (numbPeaks == 1) {
+            numJoins = loopJoins;
+            NEXTJOIN(keepq) = PREVJOIN(keepq) = p;
+            if (fc->triangulate &&
+                growBuffer((void**)&fc->monoStack, &fc->maxMonoStack, numbNodes, numbNodes, sizeof(NodeRef)))
+                return -1;
+            status |= emitPiece(fc, keepq);
+            STATS(fc->stats.monotone++);
+            STATS(endPhase(fc, PROCESS_JOINS, &phaseStart));
+            continue;
         }
+        fc->rings[i++] = keepq; /* first join of the loop */
+    }
+    numbLoops = i;
+    if (!numbLoops) {
+        fc->ws[fc->numbWs].opcode = END;
+        if (status) return -1;
+        return (fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk) - first;
+    }
 
-    } while (q != keepq);
+    /* Allocate space for sorted joins and for the nodes added while processing
+    * them. Each POSCROSSPROD join adds at most three nodes (p_in, p_out and
+    * q_in or q_out). */
+    if (growBuffer((void**)&fc->sortedJoins, &fc->maxJoins, numJoins, numJoins, sizeof(NodeRef)) ||
+        reserveNodes(fc, numbNodes, 3*numJoins))
+        return -1;
+    if (fc->triangulate &&
+        (growBuffer((void**)&fc->addedVertex, &fc->maxAddedVertex, 3*numJoins, 3*numJoins, sizeof(int)) ||
+         growBuffer((void**)&fc->monoStack, &fc->maxMonoStack, numbNodes + 3*numJoins, numbNodes + 3*numJoins, sizeof(NodeRef)) ||
+         growBuffer((void**)&fc->addedPoints, &fc->maxAddedPoints, fc->numbAddedPoints + numJoins,
+                    numJoins, sizeof(Point))))
+        return -1;
+    sortedJoins = fc->sortedJoins;
+    addedNode = fc->addedNodes;
 
     /* sort joins */
-    sortedJoins = (ChainNode**) malloc(numJoins * sizeof(ChainNode*));
+    if (sortJoins(fc, numbLoops, numJoins)) return -1;
+    STATS(endPhase(fc, SORT_JOINS, &phaseStart));
 
-    for (q = keepq, i = 0; i < numJoins; q = q->nextJoin, i++) sortedJoins[i] = q;
-    qsort((void*)sortedJoins, (size_t)numJoins, sizeof(ChainNode*),
-          compareJoins);
+    /* find the window edge on the left of each join that splits a window */
+    if ((numbSplits = findSplitHits(fc, numbNodes, numbLoops, numJoins)) < 0) return -1;
+    piece = numbSplits? fc->treapNodes + numbNodes: NULL;
+    STATS(endPhase(fc, FIND_WINDOWS, &phaseStart));
 
     /* process joins in x-order */
     for (i = 0; i < numJoins; i++) {
         q = sortedJoins[i];
-        joinType = q->joinType;
+        joinType = JOINTYPE(q);
 
         /* if at left of up-chain, mark top of chain as WINDOW */
-        if (joinType & PEAK) joinType = q->joinType |= WINDOW;
-        else q->nextJoin->joinType |= WINDOW;
+        if (joinType & PEAK) joinType = JOINTYPE(q) |= WINDOW;
+        else JOINTYPE(NEXTJOIN(q)) |= WINDOW;
+        STATS(countJoin(fc, joinType));
 
         if (joinType & POSCROSSPROD) {
+            p = NIL;
             switch (joinType & (PEAK|DOWNTORIGHT)) {
 
             case PEAK /* & !DOWNTORIGHT */:
-                topOfWindow = q->nextJoin->nextJoin;
+                topOfWindow = NEXTJOIN(NEXTJOIN(q));
                 break;
             case /* !PEAK & */ DOWNTORIGHT:
-                topOfWindow = q->prevJoin;
+                topOfWindow = PREVJOIN(q);
                 break;
 
             default: /* PEAK same as DOWNTORIGHT. */
-                /* Search for rightmost window on left of, and
-                * vertically spanning, current join.
-                * --search (backward) for first window with top above q->y
-                */
-                for ( r= q->prevJoin; !(r->joinType & WINDOW) || (r->y <= q->y); r = r->prevJoin ) {}
-
-                /* --search (backward) for next window with bottom below q->y*/
-                for ( r= r->prevJoin; (r->joinType & PEAK) || (r->y >= q->y); r = r->prevJoin ) {}
-
-                /* We are now at the bottom of first candidate window
-                * (vertically spanning q->y, on left of current join)
-                * -- find window intersection
+                /* The window containing q is the one whose left chain is hit
+                * first by a ray going left from q. Find the piece of the edge
+                * hit that spans q->y, then go up the chain to the window top.
                 */
-                for (p = r->nextJoin->prev; p->y > q->y; p = p->prev) {}
-
-                xtmp = (p->x + (p->next->x - p->x)/p->deltay * (q->y - p->y));
-                if (xtmp < q->x) {
-                    xmax = xtmp;
-                    topOfWindow = r->nextJoin;
-                } else xmax = -FLT_MAX;
-
-                for (;;) {
-                    /* search (backward) for next window with top above q->y */
-                    for (r = r->prevJoin; (r != q) && (r != q->nextJoin) &&
-                            (!(r->joinType & WINDOW) || (r->y <= q->y)); r = r->prevJoin) {}
-
-                    if ((r == q) || (r == q->nextJoin)) break;
-
-                    /* search (bckwd) for next window with bottom below q->y */
-                    for (r = r->prevJoin; (r != q) && (r != q->nextJoin) &&
-                            ((r->joinType & PEAK) || (r->y >= q->y)); r = r->prevJoin) {}
-
-                    /* We are now at the bottom of a candidate window
-                    * (vertically spanning q->y, and potentially on left)
-                    * -- find window intersection */
-                    for (p = r->nextJoin->prev; p->y > q->y; p = p->prev) {}
-
-                    xtmp = (p->x + (p->next->x - p->x) / p->deltay * (q->y - p->y));
-                    if ((xtmp < q->x) && (xtmp >= xmax)) {
-                        xmax = xtmp;
-                        topOfWindow = r->nextJoin;
-                    }
+                if (fc->rayHits[VERTEX_INDEX(q)] < 0) continue; /* not a simple polygon */
+                STATS(fc->stats.splits++);
+                p = findPiece(fc, pieces, fc->rayHits[VERTEX_INDEX(q)], Y(q));
+                for (topOfWindow = NEXT(p); !IS_JOIN(topOfWindow); topOfWindow = NEXT(topOfWindow))
+                    STATS(fc->stats.windowSteps++);
+                while ((NEXT(p) != topOfWindow) && (Y(NEXT(p)) <= Y(q))) {
+                    p = NEXT(p);
+                    STATS(fc->stats.windowSteps++);
                 }
             } /* switch */
 
-            botOfWindow = topOfWindow->prevJoin;
+            botOfWindow = PREVJOIN(topOfWindow);
 
             /* find vertical position of current join in current window */
-            for (p = topOfWindow->prev; p->y > (q->y + ALMOST_HORIZONTAL); p = p->prev) {}
+            if (p == NIL)
+                for (p = PREV(topOfWindow); Y(p) > Y(q); p = PREV(p))
+                    STATS(fc->stats.windowSteps++);
 
             /* see if new node is needed (join does not align vertically with a window node */
-            if (fabs(p->y - q->y) > ALMOST_HORIZONTAL) {
+            if (Y(p) != Y(q)) {
                 /* q lines up with edge */
-                p_in = (ChainNode*) malloc(sizeof(ChainNode));
-                p_out = (ChainNode*) malloc(sizeof(ChainNode));
-
-                p_in->joinType = p_out->joinType = ADDED_NODE;
-                p_in->deltay = (float)0;
-                p_in->y = p_out->y = q->y;
-                p_in->x = p_out->x = p->x
-                                     + (p->next->x - p->x)/p->deltay * (q->y - p->y);
-                p_out->next = p->next;
-                p->next->prev = p_out;
-                p_out->deltay = p_out->next->y - p_out->y;
-
-                p_out->nextJoin = topOfWindow;
-                p_in->prevJoin = botOfWindow;
-                topOfWindow->prevJoin = p_out;
-                p->next = p_in;
-                p_in->prev = p;
-                p->deltay = p_in->y - p->y;
+                p_in = addedNode++;
+                p_out = addedNode++;
+
+                JOINTYPE(p_in) = JOINTYPE(p_out) = ADDED_NODE;
+                PREVJOIN(p_out) = NIL;
+                DELTAY(p_in) = (Coord)0;
+                Y(p_in) = Y(p_out) = Y(q);
+                if (numbSplits) {
+                    /* p_out starts a new piece of the edge of p */
+                    fc->addedEdges[p_out - fc->addedNodes] = EDGE_OF(p);
+                    addPiece(fc, &pieces, piece++, p_out, EDGE_OF(p));
+                }
+                X(p_in) = X(p_out) = edgeX(fc, p, Y(q));
+                if (fc->triangulate) {
+                    fc->addedVertex[p_in - fc->addedNodes] =
+                        fc->addedVertex[p_out - fc->addedNodes] = n + fc->numbAddedPoints;
+                    fc->addedPoints[fc->numbAddedPoints].x = X(p_in);
+                    fc->addedPoints[fc->numbAddedPoints++].y = Y(p_in);
+                }
+                NEXT(p_out) = NEXT(p);
+                PREV(NEXT(p)) = p_out;
+                DELTAY(p_out) = Y(NEXT(p_out)) - Y(p_out);
+
+                NEXTJOIN(p_out) = topOfWindow;
+                PREVJOIN(p_in) = botOfWindow;
+                PREVJOIN(topOfWindow) = p_out;
+                NEXT(p) = p_in;
+                PREV(p_in) = p;
+                DELTAY(p) = Y(p_in) - Y(p);
             } else {
                 /* q lines up with vertex */
-                if (p->prev->deltay == (float)0) p_in = p->prev;
+                if (DELTAY(PREV(p)) == (Coord)0) p_in = PREV(p);
                 else {
-                    p_in = (ChainNode*) malloc(sizeof(ChainNode));
-                    p_in->joinType = ADDED_NODE;
-                    p_in->deltay = (float)0;
-                    p_in->prev = p->prev;
-                    p->prev = p->prev->next = p_in;
-                    p_in->deltay = (float)0;
-                    p_in->x = p->x;
-                    p_in->y = p->y;
+                    p_in = addedNode++;
+                    JOINTYPE(p_in) = ADDED_NODE;
+                    DELTAY(p_in) = (Coord)0;
+                    PREV(p_in) = PREV(p);
+                    PREV(p) = NEXT(PREV(p)) = p_in;
+                    DELTAY(p_in) = (Coord)0;
+                    X(p_in) = X(p);
+                    Y(p_in) = Y(p);
+                    if (fc->triangulate) fc->addedVertex[p_in - fc->addedNodes] = VERTEX_OF(p);
                 }
-                p_in->prevJoin = botOfWindow;
-                p_out = NULL;
+                PREVJOIN(p_in) = botOfWindow;
+                p_out = NIL;
             }
             /* relink to form two disjoint polygons */
             if (joinType & PEAK) { /* peak join */
-                if (q->prev->deltay != (float)0) {
-                    q_in = (ChainNode*) malloc(sizeof(ChainNode));
-                    q_in->joinType = ADDED_NODE;
-                    q_in->deltay = (float)0;
-                    q_in->prev = q->prev;
-                    q->prev->next = q_in;
-                    q_in->y = q->y;
-                    q_in->x = q->x;
-
-                } else q_in = q->prev;
-
-                p_in->next = q;
-                q->prev = p_in;
-                if (botOfWindow->prevJoin == q) botOfWindow->prevJoin = p_in;
-
-                p_in->nextJoin = q->nextJoin;
-                p_in->joinType |= WINDOW;
-                q->prevJoin->nextJoin = topOfWindow;
-                q->nextJoin->prevJoin = p_in;
-
-                topOfWindow->prevJoin = q->prevJoin;
-                botOfWindow->nextJoin = p_in;
-
-                if (p_out) {
+                if (DELTAY(PREV(q)) != (Coord)0) {
+                    q_in = addedNode++;
+                    JOINTYPE(q_in) = ADDED_NODE;
+                    PREVJOIN(q_in) = NIL;
+                    DELTAY(q_in) = (Coord)0;
+                    PREV(q_in) = PREV(q);
+                    NEXT(PREV(q)) = q_in;
+                    Y(q_in) = Y(q);
+                    X(q_in) = X(q);
+                    if (fc->triangulate) fc->addedVertex[q_in - fc->addedNodes] = VERTEX_INDEX(q);
+
+                } else q_in = PREV(q);
+
+                NEXT(p_in) = q;
+                PREV(q) = p_in;
+                if (PREVJOIN(botOfWindow) == q) PREVJOIN(botOfWindow) = p_in;
+
+                NEXTJOIN(p_in) = NEXTJOIN(q);
+                JOINTYPE(p_in) |= WINDOW;
+                NEXTJOIN(PREVJOIN(q)) = topOfWindow;
+                PREVJOIN(NEXTJOIN(q)) = p_in;
+
+                PREVJOIN(topOfWindow) = PREVJOIN(q);
+                NEXTJOIN(botOfWindow) = p_in;
+
+                if (p_out != NIL) {
                     /* peak join lines up horizontally with window edge */
-                    p_out->prev = q_in;
-                    q_in->next = p_out;
+                    PREV(p_out) = q_in;
+                    NEXT(q_in) = p_out;
 
                 } else { /* peak join lines up with window vertex */
-                    p->prev = q_in;
-                    q_in->next = p;
-                    q->deltay = q->next->y - q->y;
-                    q_in->prev->deltay = q_in->y - q_in->prev->y;
+                    PREV(p) = q_in;
+                    NEXT(q_in) = p;
+                    DELTAY(q) = Y(NEXT(q)) - Y(q);
+                    DELTAY(PREV(q_in)) = Y(q_in) - Y(PREV(q_in));
                 }
 
                 /* if at right side of down-chain, emit wedge sequence */
-                if (!(joinType & DOWNTORIGHT)) makeWedgeSequence(wsNumb++, p_in);
+                if (!(joinType & DOWNTORIGHT)) status |= emitPiece(fc, p_in);
 
             } else { /* valley join */
-                if (q->deltay != (float)0) {
-                    q_out = (ChainNode*) malloc(sizeof(ChainNode));
-                    q_out->joinType = ADDED_NODE;
-                    q_out->next = q->next;
-                    q->next->prev = q_out;
-                    q_out->y = q->y;
-                    q_out->x = q->x;
-
-                } else q_out = q->next;
-
-                q->nextJoin->prevJoin = botOfWindow;
-                botOfWindow->nextJoin = q->nextJoin;
-                q_out->prev = p_in;
-                p_in->next = q_out;
-                q->deltay = (float)0;
-
-                if (p_out) {
+                if (DELTAY(q) != (Coord)0) {
+                    q_out = addedNode++;
+                    JOINTYPE(q_out) = ADDED_NODE;
+                    PREVJOIN(q_out) = NIL;
+                    NEXT(q_out) = NEXT(q);
+                    PREV(NEXT(q)) = q_out;
+                    Y(q_out) = Y(q);
+                    X(q_out) = X(q);
+                    if (fc->triangulate) fc->addedVertex[q_out - fc->addedNodes] = VERTEX_INDEX(q);
+                    if (numbSplits) {
+                        /* q_out takes over the edge of q */
+                        fc->addedEdges[q_out - fc->addedNodes] = VERTEX_INDEX(q);
+                        addPiece(fc, &pieces, piece++, q_out, VERTEX_INDEX(q));
+                    }
+
+                } else q_out = NEXT(q);
+
+                PREVJOIN(NEXTJOIN(q)) = botOfWindow;
+                NEXTJOIN(botOfWindow) = NEXTJOIN(q);
+                PREV(q_out) = p_in;
+                NEXT(p_in) = q_out;
+                DELTAY(q) = (Coord)0;
+
+                if (p_out != NIL) {
                     /* valley join lines up horizontally with window edge */
-                    if (topOfWindow->nextJoin == q) topOfWindow->nextJoin = p_out;
-                    else q->prevJoin->nextJoin = p_out;
+                    if (NEXTJOIN(topOfWindow) == q) NEXTJOIN(topOfWindow) = p_out;
+                    else NEXTJOIN(PREVJOIN(q)) = p_out;
 
-                    p_out->prev = q;
-                    q->next = p_out;
-                    p_out->prevJoin = q->prevJoin;
-                    topOfWindow->prevJoin = p_out;
-                    p_out->nextJoin = topOfWindow;
+                    PREV(p_out) = q;
+                    NEXT(q) = p_out;
+                    PREVJOIN(p_out) = PREVJOIN(q);
+                    PREVJOIN(topOfWindow) = p_out;
+                    NEXTJOIN(p_out) = topOfWindow;
 
                 } else {
                     /* valley join lines up horizontally with window vertex */
-                    if (topOfWindow->nextJoin == q) topOfWindow->nextJoin = p;
-                    else q->prevJoin->nextJoin = p;
+                    if (NEXTJOIN(topOfWindow) == q) NEXTJOIN(topOfWindow) = p;
+                    else NEXTJOIN(PREVJOIN(q)) = p;
 
-                    q->next = p;
-                    p->prev = q;
-                    p->prevJoin = q->prevJoin;
+                    NEXT(q) = p;
+                    PREV(p) = q;
+                    PREVJOIN(p) = PREVJOIN(q);
 
-                    topOfWindow->prevJoin = p;
-                    p->nextJoin = topOfWindow;
-                    q->prev->deltay = q->y - q->prev->y;
+                    PREVJOIN(topOfWindow) = p;
+                    NEXTJOIN(p) = topOfWindow;
+                    DELTAY(PREV(q)) = Y(q) - Y(PREV(q));
                 }
-                q_out->deltay = q_out->next->y - q_out->y;
+                DELTAY(q_out) = Y(NEXT(q_out)) - Y(q_out);
                 /* if at right side of down-chain, emit wedge sequence */
-                if (joinType & DOWNTORIGHT) makeWedgeSequence(wsNumb++, topOfWindow);
+                if (joinType & DOWNTORIGHT) status |= emitPiece(fc, topOfWindow);
             }
         } else {
             if (joinType & DCUSP) { /* Handle DCUSP case */
-                if (joinType & PEAK) makeWedgeSequence(wsNumb++, q);
-                else makeWedgeSequence(wsNumb++, q->prevJoin);
+                if (joinType & PEAK) status |= emitPiece(fc, q);
+                else status |= emitPiece(fc, PREVJOIN(q));
 
             } else if (joinType &UCUSP) {/* Handle UCUSP case */
-                q->nextJoin->prevJoin = q->prevJoin;
-                q->prevJoin->nextJoin = q->nextJoin;
+                PREVJOIN(NEXTJOIN(q)) = PREVJOIN(q);
+                NEXTJOIN(PREVJOIN(q)) = NEXTJOIN(q);
 
             } else if (joinType & PEAK) {
-                if (!(joinType & DOWNTORIGHT)) makeWedgeSequence(wsNumb++, q);
+                if (!(joinType & DOWNTORIGHT)) status |= emitPiece(fc, q);
 
             } else {
-                if (joinType & DOWNTORIGHT) makeWedgeSequence(wsNumb++, q->nextJoin);
+                if (joinType & DOWNTORIGHT) status |= emitPiece(fc, NEXTJOIN(q));
             }
         }
     }
-    ws[wsNumb].opcode = END;
+    STATS(endPhase(fc, PROCESS_JOINS, &phaseStart));
+    STATS(fc->stats.addedNodes += addedNode - fc->addedNodes);
+    fc->ws[fc->numbWs].opcode = END;
+    if (status) return -1;
+    return (fc->triangulate? fc->numbTriangles: fc->numbWs + fc->numbSunk) - first;
 }
 /*-------------------------------------------------------*/
-int compareJoins( const void *pp, const void *qq)
-{
-    ChainNode *p = *((ChainNode**)pp), *q = *((ChainNode**)qq);
-    if (q->x == p->x) return (q->y > p->y)? 1: -1; /* ties are done in decreasing y value */
-    else return (p->x > q->x)? 1: -1;
+int appendRings(FillContext *fc, int numbRings, Point v[], const int ringOffsets[]) {
+/*----------------------------------------------
+ * Assumptions:
+ * 1. Ring k is v[ringOffsets[k] .. ringOffsets[k+1]-1]. Outer rings are
+ *    given in clockwise order, holes in counterclockwise order.
+ * 2. There are no crossing edges.
+ *
+ * If fc->cleanInput is set, neither is assumed: repeated vertices and
+ * spikes are removed, rings are oriented by how deeply they are nested
+ * (see cleanRings), and nothing is added if edges cross or touch.
+ * If fc->fillRule is NON_ZERO or EVEN_ODD, the rings may cross, and the
+ * region they fill by that rule is decomposed (see appendFilled).
+ * If fc->clip is set and a vertex is outside the clip rectangle, only the
+ * part inside is decomposed (see appendClipped).
+ *
+ * All rings are decomposed in one pass; holes are linked into the ring
+ * around them first (see linkHoles), and a hole that is in no ring is
+ * left out. A ring that is y-monotone is output as it is, without its
+ * joins being sorted or processed (see appendMonotone).
+ *
+ * If fc->tolerance is set (and not fc->triangulate), the output may be
+ * off the rings by that many pixels, to save vertices and wedges: the
+ * rings are simplified within it (see simplifyRings) and checked for
+ * edges that cross or touch, in a sweep like that of fc->cleanInput, and
+ * decomposed as they were if simplifying made them; and a right vertex
+ * that close below or above a left one is put at its height in the
+ * wedges (see makeWedgeSequence). Parts narrower than the tolerance may
+ * come out wrong.
+ *
+ * The wedge sequences (or triangles) are appended to the ones already in
+ * fc, or passed to fc->sink if set. Returns the number of wedge sequences
+ * (or triangles) added, -1 if out of memory or the sink stopped, or -2
+ * if fc->cleanInput is set and edges cross or touch.
+ *
+ * Note:
+ * "Up" and "down" assume the y-axis is in "upward" direction.
+ */
+    int status, n = ringOffsets[numbRings];
+
+    STATS(double phaseStart = statsTime());
+
+    if (fc->clip && !insideClip(fc, n, v)) return appendClipped(fc, numbRings, v, ringOffsets);
+    if (fc->fillRule != ORIENTED) return appendFilled(fc, numbRings, v, ringOffsets, noStrips, 1, NULL, NULL, 0);
+    if (fc->tolerance > 0 && !fc->triangulate) {
+        if ((status = simplifyRings(fc, numbRings, v, ringOffsets)) < 0) return -1;
+        STATS(endPhase(fc, SIMPLIFY_RINGS, &phaseStart));
+        if (status > 0) {
+            status = decomposeRings(fc, numbRings, fc->simplePoints, fc->simpleOffsets, 1);
+            if (status != -2) return status;
+            /* simplifying made them cross or touch (or they did): decompose them as they are */
+        }
+    }
+    return decomposeRings(fc, numbRings, v, ringOffsets, 0);
 }
 /*-------------------------------------------------------*/
-void makeWedgeSequence(int wsNumb, ChainNode *topOfWindow)
+int makeWedgeSequence(FillContext *fc, NodeRef topOfWindow)
 {
-    float bb_xmin, bb_xmax; /* bounding box for wedge sequence */
-    float prevy;
-    int i = 0; /* wedge element index */
-    ChainNode *botOfWindow = topOfWindow->prevJoin;
-    ChainNode *p, *q;
-    /* Preprocess chains to reduce number of wedges of left and right
-    * vertices almost align
-    */
-    /* p = q = topOfWindow;
-     do {
-     if ((q->deltay == (float)0) || (p->y < q->y - ALMOST_HORIZONTAL))
-     q = q->next;
-     else if (p->y > q->y + ALMOST_HORIZONTAL
-     p = p->prev;
-     else {
-     q->y = p->y;
-     if (q->prev->deltay == (float)0) {
-     q->prev->y = p->y;
-     q->prev->prev->deltay = q->prev->y - q->prev->prev->y;
-     } else
-     q->prev->deltay = q->y - q->prev->y;
-     q->deltay = q->next->y - q->y;
-     q = q->next;
-     p = p->prev;
-     }
-     } while (p != q);
-    */
-
-    ws[wsNumb].opcode = WEDGE_SEQ;
-    ws[wsNumb].y = topOfWindow->y;
-    ws[wsNumb].pht = topOfWindow->y - botOfWindow->y;
+/* Append the wedge sequence of the monotone polygon below topOfWindow
+ * to the output of fc, or pass it to fc->sink.
+ * Returns -1 if out of memory or the sink stopped. */
+    Coord bb_xmin, bb_xmax; /* bounding box for wedge sequence */
+    NodeRef botOfWindow = PREVJOIN(topOfWindow);
+    NodeRef p, q;
+    Chain left, right;
+    Coord tolerance = (Coord)TOLERANCE(fc), /* how far a right vertex may be moved */
+          y, above; /* height the right vertex q is taken to be at, and the one before it */
+    int numbYs = 0;
+
+    /* A right vertex close enough below or above a left one is taken to
+     * be at its height in the wedges, to save one, unless that would make
+     * an edge horizontal or out of order, or it is a copy made by a cut
+     * (at the end of a horizontal edge). The vertices stay where they are.
+     * The chains are followed down until they meet (botOfWindow may be a
+     * copy of the bottom that is not on them). */
+    if (tolerance > 0)
+        for (p = PREV(topOfWindow), q = NEXT(topOfWindow), above = Y(topOfWindow);
+             p != q && p != botOfWindow && q != botOfWindow; ) {
+            if (Y(p) > Y(q) + tolerance) p = PREV(p);
+            else {
+                y = Y(q);
+                if (Y(q) <= Y(p) + tolerance && Y(q) != Y(p) && DELTAY(PREV(q)) < 0 && DELTAY(q) < 0 &&
+                    Y(NEXT(q)) < Y(p) && Y(p) < above) {
+                    y = Y(p);
+                    STATS(fc->stats.aligned++);
+                }
+                if (growBuffer((void**)&fc->alignedYs, &fc->maxAlignedYs, numbYs + 1, NUMB_WS, sizeof(Coord)))
+                    return -1;
+                fc->alignedYs[numbYs++] = above = y;
+                q = NEXT(q);
+            }
+        }
+
     /* find x-range of wedge sequence (for bounding box) */
-    bb_xmin = botOfWindow->x;
-    for (p = topOfWindow; p != topOfWindow->nextJoin; p = p->prev)
-        if (p->x < bb_xmin)
-            bb_xmin = p->x;
-    bb_xmax = topOfWindow->nextJoin->x;
-    for (q = topOfWindow; q != topOfWindow->nextJoin; q = q->next)
-        if (q->x > bb_xmax)
-            bb_xmax = q->x;
-    ws[wsNumb].x = bb_xmin;
-    ws[wsNumb].pwidth = bb_xmax - bb_xmin;
-    p = q = topOfWindow;
-    ws[wsNumb].we[0].wedgeType = BOTH;
-    ws[wsNumb].we[0].lCorr = p->x - bb_xmin;
-    if (p->deltay == (float)0) {
-        q = q->next;
-        ws[wsNumb].we[0].rCorr = q->x - bb_xmin;
-    } else
-        ws[wsNumb].we[0].rCorr = ws[wsNumb].we[0].lCorr;
-    ws[wsNumb].we[0].lSlope = (p->x - p->prev->x)/p->prev->deltay;
-    ws[wsNumb].we[0].rSlope = -(q->x - q->next->x)/q->deltay;
-    for (prevy = topOfWindow->y, q = q->next, p = p->prev; p != q; ) {
-        i++;
-        if (p->y < (q->y - ALMOST_HORIZONTAL)) {
-            ws[wsNumb].we[i].wedgeType = RIGHT;
-            ws[wsNumb].we[i-1].height = prevy - q->y;
-            prevy = q->y;
-            if (q->deltay == (float)0) {
-                q = q->next;
-                ws[wsNumb].we[i].rCorr = q->x - q->prev->x;
-            } else
-                ws[wsNumb].we[i].rCorr = (float)0;
-            ws[wsNumb].we[i].rSlope = -(q->x - q->next->x)/q->deltay;
-            q = q->next;
-        } else if (p->y > (q->y + ALMOST_HORIZONTAL)) {
-            ws[wsNumb].we[i].wedgeType = LEFT;
-            ws[wsNumb].we[i-1].height = prevy - p->y;
-            prevy = p->y;
-            if (p->prev->deltay == (float)0) {
-                p = p->prev;
-                ws[wsNumb].we[i].lCorr = p->x - p->next->x;
-            } else
-                ws[wsNumb].we[i].lCorr = (float)0;
-            ws[wsNumb].we[i].lSlope = (p->x - p->prev->x)/p->prev->deltay;
-            p = p->prev;
-        } else {
+    bb_xmin = X(botOfWindow);
+    for (p = topOfWindow; p != NEXTJOIN(topOfWindow); p = PREV(p))
+        if (X(p) < bb_xmin)
+            bb_xmin = X(p);
+    bb_xmax = X(NEXTJOIN(topOfWindow));
+    for (q = topOfWindow; q != NEXTJOIN(topOfWindow); q = NEXT(q))
+        if (X(q) > bb_xmax)
+            bb_xmax = X(q);
+    startChain(fc, &left, topOfWindow, NULL, 0, 0, -1, NULL, 0);
+    startChain(fc, &right, topOfWindow, NULL, 0, 0, 1, fc->alignedYs, numbYs);
+    return emitWedges(fc, &left, &right, bb_xmin, bb_xmax, Y(botOfWindow));
+}
 
-            ws[wsNumb].we[i-1].height = prevy - p->y; /*pick left vertex height*/
-            if (q->deltay == (float)0) {
-                q = q->next;
-                if (p == q) { /* if bottom of sequence is horizontal */
-                    i--;
-                    break;
-                }
-                ws[wsNumb].we[i].rCorr = q->x - q->prev->x;
-            } else
-                ws[wsNumb].we[i].rCorr = (float)0;
-            ws[wsNumb].we[i].wedgeType = BOTH;
-            prevy = p->y;
-            ws[wsNumb].we[i].rSlope = -(q->x - q->next->x)/q->deltay;
-            q = q->next;
-            if (p->prev->deltay == (float)0) {
-                p = p->prev;
-                ws[wsNumb].we[i].lCorr = p->x - p->next->x;
-            } else
-                ws[wsNumb].we[i].lCorr = (float)0;
-            ws[wsNumb].we[i].lSlope = (p->x - p->prev->x)/p->prev->deltay;
-            p = p->prev;
+/*-------------------------------------------------------*/
+static int addTriangle(FillContext *fc, NodeRef a, NodeRef b, NodeRef c)
+{
+/* Append triangle abc to fc->triangles in clockwise order, unless it has
+ * no area. Returns -1 if out of memory. */
+    double area = orient(fc, a, b, c);
+    int *t;
+
+    if (area == 0) return 0;
+    if (growBuffer((void**)&fc->triangles, &fc->maxTriangles, 3*(fc->numbTriangles + 1),
+                   3*NUMB_WS, sizeof(int)))
+        return -1;
+    t = fc->triangles + 3*fc->numbTriangles++;
+    t[0] = VERTEX_OF(a);
+    t[1] = VERTEX_OF(area < 0? b: c);
+    t[2] = VERTEX_OF(area < 0? c: b);
+    return 0;
+}
+/*-------------------------------------------------------*/
+int triangulateMonotone(FillContext *fc, NodeRef topOfWindow)
+{
+/*----------------------------------------------
+ * Append the triangles of the monotone polygon below topOfWindow to
+ * fc->triangles.
+ *
+ * The vertices of the left (prev) and right (next) chains are merged
+ * from the top down. A stack holds the vertices above that still need
+ * a diagonal; they are all on one chain and form a reflex path. A vertex
+ * on the other chain sees all of them; a vertex on the same chain cuts
+ * off the corners at the top of the stack while they are convex.
+ * Returns -1 if out of memory.
+ */
+    NodeRef *stack = fc->monoStack;
+    NodeRef l = PREV(topOfWindow), r = NEXT(topOfWindow), u;
+    int top = 1, side = 0, uSide, i; /* side of stack: 0 = left, 1 = right */
+
+    if (l == r) return 0; /* no area */
+    stack[0] = topOfWindow;
+    if (Y(l) > Y(r)) {
+        stack[1] = l;
+        l = PREV(l);
+    } else {
+        stack[1] = r;
+        r = NEXT(r);
+        side = 1;
+    }
+    while (l != r) {
+        if (Y(l) > Y(r)) {
+            u = l;
+            l = PREV(l);
+            uSide = 0;
+        } else {
+            u = r;
+            r = NEXT(r);
+            uSide = 1;
+        }
+        if (uSide != side) { /* u sees the whole stack */
+            for (i = 0; i < top; i++)
+                if (addTriangle(fc, u, stack[i], stack[i+1])) return -1;
+            stack[0] = stack[top];
+            top = 1;
+        } else { /* cut off the convex corners at the stack top */
+            while (top > 0 && (side? orient(fc, stack[top-1], stack[top], u):
+                                     orient(fc, u, stack[top], stack[top-1])) <= 0) {
+                if (addTriangle(fc, u, stack[top], stack[top-1])) return -1;
+                top--;
+            }
+            top++;
         }
+        stack[top] = u;
+        side = uSide;
     }
-    ws[wsNumb].we[i].height = prevy - botOfWindow->y;
-    ws[wsNumb].we[i].wedgeType |= LAST_WE;
+    /* the bottom sees the whole stack */
+    for (i = 0; i < top; i++)
+        if (addTriangle(fc, l, stack[i], stack[i+1])) return -1;
+    return 0;
 }
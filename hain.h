@@ -7,12 +7,12 @@
 #include <float.h>
 #include <math.h>
 
-#define NUMB_WE 200
-#define NUMB_WS 400
-//#define FLATNESS .2
-#define FLATNESS .0
-//#define ALMOST_HORIZONTAL .1
-#define ALMOST_HORIZONTAL .0
+#define NUMB_WE 200 /* initial size of wedge element buffer */
+#define NUMB_WS 400 /* initial size of wedge sequence buffer */
+//#define INDEX_NODES /* chain nodes in separate arrays, linked by 32-bit indices */
+//#define FILL_STATS /* count and time the phases of fillPoly() in FillContext.stats */
+//#define DOUBLE_COORDS /* double coordinates */
+//#define FIXED_COORDS /* 32-bit fixed-point coordinates, with exact cross products */
 /* joinType bits */
 #define DOWNTORIGHT 1
 #define PEAK 2
@@ -25,39 +25,364 @@
 
 typedef unsigned JoinType;
 
+/* Coord is the type of coordinates and their differences, Real that of
+ * slopes. Fixed-point coordinates have FIXED_SHIFT fractional bits and
+ * must be less than 2^30 in magnitude, so that cross products of their
+ * differences are exact in 64 bits. Nodes added on an edge are rounded
+ * to the nearest fixed-point value. */
+#if defined(FIXED_COORDS)
+#define FIXED_SHIFT 8
+typedef int Coord;
+typedef double Real;
+#elif defined(DOUBLE_COORDS)
+typedef double Coord;
+typedef double Real;
+#else
+typedef float Coord;
+typedef float Real;
+#endif
+
 typedef struct ChainNodeTag {
-    float x,y;
-    float deltay; /* ynext - y */
+    Coord x,y;
+    Coord deltay; /* ynext - y */
     JoinType joinType;
     struct ChainNodeTag *prev, *next, *nextJoin, *prevJoin;
 } ChainNode;
 
+#ifdef INDEX_NODES
+typedef int NodeRef; /* index into the node arrays of a FillContext */
+#define NIL (-1)
+
+/* The fields of ChainNode, one array each */
+typedef struct {
+    Coord *x, *y;
+    Coord *deltay;
+    JoinType *joinType;
+    NodeRef *prev, *next, *nextJoin, *prevJoin;
+} ChainNodes;
+#else
+typedef ChainNode *NodeRef;
+#define NIL NULL
+#endif
+
 typedef struct {
-    float x,y;
+    Coord x,y;
 } Point;
 
+/* Node of the balanced trees used to find the window left of a split join.
+ * An up-chain is kept at the index of its lowest vertex, the pieces that
+ * up-edges are cut into by added nodes after all vertices. */
+typedef struct TreapNodeTag {
+    struct TreapNodeTag *left, *right, *parent;
+    unsigned prio; /* heap order (pseudo-random) */
+    NodeRef node; /* upper vertex of the current edge of a chain, or start of a piece */
+    Coord x, y; /* lower vertex of the current edge of a chain, or start of a piece */
+    Real slope; /* (inverse) slope of the current edge of a chain */
+    Coord top; /* y of the upper end of a chain */
+    int edge; /* current edge of a chain, or edge a piece belongs to */
+} TreapNode;
+
+/* sort key of a join: x ascending, then y descending */
+typedef struct {
+    unsigned long long key;
+#ifdef DOUBLE_COORDS
+    unsigned long long low; /* ties of key sorted by low (a coordinate takes 64 bits) */
+#endif
+    int node; /* index of the join in the vertex loop */
+} JoinKey;
+
+/* One side of a monotone piece, followed down from its top to make the
+ * wedges: the vertex at (x, y) and the one after it at (nx, ny). The side
+ * is on a vertex loop, at node, or else on a ring v[0 .. n-1], at v[i].
+ * The first numbYs vertices after the top are taken to be at ys[0 ..
+ * numbYs-1] rather than at their own height. */
+typedef struct {
+    NodeRef node, nextNode; /* NIL on a ring */
+    const Point *v; /* NULL on a vertex loop */
+    int n, i, ni; /* 0 on a vertex loop */
+    int d; /* by NEXT or forward if > 0, by PREV or back if < 0 */
+    Coord x, y, nx, ny;
+    const Coord *ys; /* NULL if numbYs is 0 */
+    int numbYs, k; /* k of the vertices after the top passed */
+} Chain;
+
+#ifdef FILL_STATS
+/* Phases of fillPoly(), in the order they run */
+typedef enum {
+    CLIP_RINGS, /* rings cut or clamped to the clip rectangle (with clip) */
+    SIMPLIFY_RINGS, /* rings simplified within the tolerance (with tolerance) */
+    BUILD_RINGS, /* vertex loops */
+    SWEEP_BANDS, /* trapezoids of the filled region (fillRule only) */
+    CLEAN_RINGS, /* repeats removed, rings checked and oriented (with cleanInput) */
+    LINK_HOLES,
+    REMOVE_COLLINEAR,
+    COLLECT_JOINS, /* chains and joins */
+    SORT_JOINS,
+    FIND_WINDOWS, /* edges hit from split joins */
+    PROCESS_JOINS, /* without EMIT_PIECES */
+    EMIT_PIECES, /* wedge sequences or triangles of the monotone pieces */
+    NUMB_PHASES
+} Phase;
+
+extern const char *phaseNames[NUMB_PHASES];
+
+/* Counts and times of fillPoly(). Cleared by fillPoly(), fillRings(),
+ * fillStrips() and moveVertices(), added to by appendPoly() and
+ * appendRings(). */
+typedef struct {
+    double seconds[NUMB_PHASES]; /* time spent in each phase */
+    long joins; /* joins processed */
+    long peaks, dcusps, ucusps, posCrossProds; /* joins with that joinType bit */
+    long splits; /* joins whose window is found from the edge hit */
+    long addedNodes; /* ADDED_NODEs created */
+    long windowSteps; /* nodes passed finding a join's place in its window */
+    long pieces; /* monotone pieces emitted */
+    long monotone; /* of which loops that were monotone to begin with */
+    long wedges, maxWedges; /* wedge elements of all sequences, most in one */
+    long snapped, flattened, aligned; /* vertices moved or dropped by the tolerance */
+} FillStats;
+#endif
+
+/* How appendRings() fills its rings */
+typedef enum {
+    ORIENTED, /* outer rings clockwise, holes counterclockwise, no crossings */
+    NON_ZERO, /* where the rings wind around a point other than zero times */
+    EVEN_ODD /* where the rings wind around a point an odd number of times */
+} FillRule;
+
+/* Non-horizontal edge of the rings, with a FillRule other than ORIENTED */
+typedef struct {
+    Coord xb, yb, xt, yt; /* bottom and top end */
+    Real slope; /* (inverse) slope */
+    int wind; /* 1 if the ring goes up the edge, -1 if down */
+    int node; /* its treap node while the sweep crosses it, else -1 */
+    int right; /* winding number of the rings right of it */
+    int trap; /* open trapezoid right of it, or -1 */
+    int touched, wound; /* last stop of the sweep that touched it, that found right */
+} FillEdge;
+
+/* Trapezoid of the filled region between two edges that are neighbours
+ * in the sweep of appendFilled(), from the stop where they became
+ * neighbours to the one where they stopped being */
+typedef struct {
+    Coord yt, yb; /* top and bottom */
+    Coord xlt, xrt, xlb, xrb; /* left and right x at the top and bottom */
+    int left, right; /* edges */
+    int below; /* trapezoid that continues this one below, or -1 (next free one if free) */
+    int first; /* first trapezoid of the run this one continues */
+} Trapezoid;
+
+/* Entry of the list of the edges through a strip of fillStrips() */
+typedef struct {
+    int edge; /* by the vertex it starts at */
+    int next; /* entry, or -1 (next free one if free) */
+} StripEdge;
+
+/* Crossing of two neighbouring edges below the sweep of appendFilled() */
+typedef struct {
+    Coord y;
+    int left, right; /* edges */
+} EdgeCrossing;
+
+/* Run of a ring inside the clip rectangle, from where it enters to where
+ * it leaves (see clipRings) */
+typedef struct {
+    Point in, out; /* on the sides, or at a vertex */
+    double at[2]; /* where along its side each is, before rounding */
+    int first, numb; /* its vertices: numb of them on from v[first] */
+    int ring;
+    int next; /* piece that comes next clockwise along the sides, -1 once output */
+    int corners; /* corners of the rectangle passed on the way to it */
+} ClipPiece;
+
 typedef enum {WEDGE_SEQ, END} Opcode;
 
 typedef enum {LEFT, RIGHT, BOTH} WedgeType; /* sign bit = 1 if last element */
 
 typedef struct {
     WedgeType wedgeType; /* type of wedge: LEFT, RIGHT, BOTH */
-    float height; /* height of wedge */
-    float lCorr, rCorr; /* correction relative to last wedge */
-    float lSlope, rSlope; /* (inverse) slopes (delta_x/delta_y) */
+    Coord height; /* height of wedge */
+    Coord lCorr, rCorr; /* correction relative to last wedge */
+    Real lSlope, rSlope; /* (inverse) slopes (delta_x/delta_y) */
 } WedgeElement;
 
 typedef struct {
     int opcode; /* type of object */
-    float x,y; /* top-left coord of bounding box for all wedge element */
-    float pwidth, pht; /* bounding box */
-    WedgeElement we[NUMB_WE];
+    Coord x,y; /* top-left coord of bounding box for all wedge element */
+    Coord pwidth, pht; /* bounding box */
+    int firstWe, numbWe; /* wedge elements of this sequence in FillContext.we */
 } WedgeSequence;
 
-int compareJoins(const void *pp, const void *qq);
+/* Receives each wedge sequence as soon as it is complete, with its wedge
+ * elements we[0 .. s->numbWe-1]. Both are only valid during the call.
+ * Returns 0, or -1 to stop the decomposition. */
+typedef int (*WedgeSink)(void *data, const WedgeSequence *s, const WedgeElement *we);
+
+/* Wedge sequences written by storeWedges() into one block of memory
+ * that can be saved as is and read in place (see store.cpp): this
+ * header, then for each sequence a StoredSequence followed by the type
+ * of each wedge element (one byte each, padded to a multiple of 4), its
+ * values as 32-bit floats, and with STORE_HALF_SLOPES its slopes as
+ * 16-bit floats. The values of an element are its height, then lCorr
+ * and lSlope unless it is a RIGHT wedge, then rCorr and rSlope unless it
+ * is a LEFT wedge, in pixels, leaving out the slopes that are 16-bit.
+ * Everything is in native byte order. */
+#define STORE_VERSION 1
+#define STORE_HALF_SLOPES 1 /* flag: slopes as 16-bit floats */
+
+typedef struct {
+    char magic[4]; /* "HAIN" */
+    unsigned version; /* STORE_VERSION */
+    unsigned flags; /* STORE_HALF_SLOPES */
+    unsigned numbWs; /* wedge sequences */
+    unsigned long long size; /* bytes of the store, this header included */
+} StoreHeader;
+
+typedef struct {
+    float x, y; /* top-left coord of bounding box, in pixels */
+    float pwidth, pht; /* bounding box */
+    unsigned numbWe; /* wedge elements */
+    unsigned numbValues; /* 32-bit float values of the wedge elements */
+    unsigned size; /* bytes to the next sequence, this struct included */
+} StoredSequence;
+
+/* 8-bit coverage buffer filled by fillWedges() */
+typedef struct {
+    unsigned char *mask; /* pixel (i, j) at mask[j*stride + i] */
+    int width, height, stride;
+    int samples; /* sample lines per pixel row for anti-aliasing (<= 1: none) */
+} Mask;
+
+/* Decomposition context. One per thread; the output buffers are owned by
+ * the context, grow as needed and are reused by the next fillPoly() call.
+ * The node arena is scratch storage for fillPoly(), so once the buffers
+ * have grown to fit the input, a call does no heap allocation.
+ * If sink is set, each wedge sequence is passed to it instead of being
+ * kept, and ws/we only hold the sequence being built.
+ * If triangulate is set, the monotone pieces are cut into triangles
+ * instead of wedge sequences. A triangle is three vertex indices, in
+ * clockwise order; index i of a polygon of n vertices is v[i] if i < n,
+ * else addedPoints[i - n]. */
+typedef struct {
+    WedgeSequence *ws; /* wedge sequences, terminated by an END opcode */
+    WedgeElement *we; /* wedge elements of all sequences */
+    int numbWs, maxWs; /* used/allocated wedge sequences */
+    int numbWe, maxWe; /* used/allocated wedge elements */
+    WedgeSink sink; /* receives the wedge sequences, if set */
+    void *sinkData; /* first argument of sink */
+    int numbSunk; /* wedge sequences passed to sink */
+
+    int triangulate; /* make triangles instead of wedge sequences */
+    int *triangles; /* vertex indices, three per triangle */
+    Point *addedPoints; /* vertices that are not in the input */
+    int numbTriangles, maxTriangles; /* used/allocated triangles */
+    int numbAddedPoints, maxAddedPoints; /* used/allocated added points */
+    int *addedVertex; /* vertex index of each ADDED_NODE */
+    NodeRef *monoStack; /* vertices of a monotone piece waiting to be cut off */
+    int *bridgeVertex; /* vertex index of each node that links in a hole */
+    int maxAddedVertex, maxMonoStack, maxBridgeVertex; /* allocated sizes */
+
+    int cleanInput; /* remove repeats, check and orient the rings first */
+    int *ringInfo; /* ring of each vertex, then depth of each ring (see cleanRings) */
+    int maxRingInfo; /* allocated size */
+
+    FillRule fillRule; /* how the rings are filled (see appendRings) */
+    FillEdge *fillEdges; /* non-horizontal edges of the rings */
+    int *activeEdges; /* edges touched at the current stop of the sweep, and the trapezoids it ends */
+    Trapezoid *trapezoids; /* of the runs not yet output, and free ones */
+    EdgeCrossing *crossings; /* heap of the crossings the sweep is to stop at, highest first */
+    int maxFillEdges, maxActive, maxTrapezoids, maxCrossings; /* allocated sizes */
+
+    Coord *strips; /* y of the strip boundaries of fillStrips(), top down */
+    int *stripWs; /* first wedge sequence of each strip and the end, then scratch */
+    int *stripLists; /* first entry of the list of the edges through each strip, or -1 */
+    StripEdge *stripEdges; /* entries of the lists, and free ones */
+    int *edgeStamps; /* last moveVertices() call that took the edge of each vertex, then the edges it took */
+    int numbStrips, maxStrips, maxStripWs; /* strips, allocated sizes */
+    int numbStripEdges, freeStripEdge, moveStamp; /* entries used, first free one, moveVertices() calls */
+    int maxStripLists, maxStripEdges, maxEdgeStamps; /* allocated sizes */
+
+    int clip; /* decompose only what is inside clipMin .. clipMax (see appendClipped) */
+    Point clipMin, clipMax; /* bottom-left and top-right corner of the clip rectangle */
+    Point *clipPoints; /* the rings cut or clamped to the clip rectangle */
+    int *clipOffsets; /* their ring offsets */
+    int *clipVertices; /* vertex of the rings each of them is, or -1 */
+    ClipPiece *clipPieces; /* runs of the rings inside the rectangle */
+    int maxClipPoints, maxClipOffsets, maxClipVertices, maxClipPieces; /* allocated sizes */
+
+    double tolerance; /* in pixels: how far the rings may be moved to save wedges, 0 for exact (see appendRings) */
+    Point *simplePoints; /* the rings simplified within it (see simplifyRings) */
+    int *simpleOffsets; /* their ring offsets */
+    Coord *alignedYs; /* heights of the right side of a wedge sequence, aligned within it (see makeWedgeSequence) */
+    int maxSimplePoints, maxSimpleOffsets, maxAlignedYs; /* allocated sizes */
+
+#ifdef INDEX_NODES
+    ChainNodes nodes; /* vertex loop, then ADDED_NODEs */
+    NodeRef addedNodes; /* first ADDED_NODE */
+#else
+    ChainNode *nodes; /* vertex loop */
+    ChainNode *addedNodes; /* ADDED_NODEs created while processing joins */
+#endif
+    NodeRef *rings; /* a node of each vertex loop, later its first join */
+    int numbVertices, maxRings; /* vertices of the polygon, allocated rings */
+    NodeRef *sortedJoins; /* joins in x-order */
+    JoinKey *joinKeys; /* sort keys of the joins, and as many for scratch */
+    int maxNodes, maxAdded, maxJoins, maxJoinKeys; /* allocated sizes of the above */
+
+    NodeRef *splitJoins; /* joins that split a window, by y */
+    TreapNode **sweepChains; /* up-chains by lower, then by upper vertex */
+    TreapNode *treapNodes; /* up-chains by lowest vertex, then edge pieces */
+    int *rayHits; /* edge hit going left from a split join, by vertex index */
+    int *addedEdges; /* edge of an added node that starts an edge piece */
+    int maxSplits, maxSweep, maxTreap, maxRayHits, maxAddedEdges; /* allocated sizes */
+
+#ifdef FILL_STATS
+    FillStats stats;
+#endif
+} FillContext;
+
+void initFillContext(FillContext *fc);
+
+void freeFillContext(FillContext *fc);
+
+int reserveWedges(FillContext *fc, int numbWs, int numbWe);
+
+int makeWedgeSequence(FillContext *fc, NodeRef topOfWindow);
+
+int triangulateMonotone(FillContext *fc, NodeRef topOfWindow);
+
+int fillPoly(FillContext *fc, int n, Point v[]);
+
+int appendPoly(FillContext *fc, int n, Point v[]);
+
+int fillRings(FillContext *fc, int numbRings, Point v[], const int ringOffsets[]);
+
+int appendRings(FillContext *fc, int numbRings, Point v[], const int ringOffsets[]);
+
+int fillStrips(FillContext *fc, int numbRings, Point v[], const int ringOffsets[], int numbStrips);
+
+int moveVertices(FillContext *fc, int numbRings, Point v[], const int ringOffsets[],
+                 int numbMoved, const int moved[], const Point to[]);
+
+int fillPolys(FillContext *fc, int numbPolys, Point v[], const int ringOffsets[],
+              int wsOffsets[], int numbThreads);
+
+int fillSlabs(FillContext *fc, int numbRings, Point v[], const int ringOffsets[], int numbThreads);
+
+void fillWedges(Mask *m, const WedgeSequence *s, const WedgeElement *we);
+
+int maskSink(void *m, const WedgeSequence *s, const WedgeElement *we);
+
+void fillStore(Mask *m, const void *store);
+
+float halfToFloat(unsigned short h);
+
+size_t storeWedges(const FillContext *fc, unsigned flags, void *buf, size_t bufSize);
+
+int checkStore(const void *data, size_t size);
 
-void makeWedgeSequence(int wsNumb, ChainNode *topOfWindow);
+int writeStore(const char *path, const FillContext *fc, unsigned flags);
 
-void fillPoly(int n, Point v[], WedgeSequence ws[]);
+const void *mapStore(const char *path, size_t *size);
 
-WedgeSequence ws[NUMB_WS];
+void unmapStore(const void *data, size_t size);
@@ -1,5 +1,14 @@
 
-if (typeof module !== 'undefined') module.exports = hain;
+if (typeof module !== 'undefined') {
+    // the native addon (addon.cpp) where it is built, with this one as its .js
+    try {
+        module.exports = require('./build/Release/hain.node');
+        module.exports.js = hain;
+    } catch (e) {
+        if (e.code !== 'MODULE_NOT_FOUND') throw e;
+        module.exports = hain;
+    }
+}
 
 var FLATNESS = 0,
     ALMOST_HORIZONTAL = 0,
@@ -388,7 +397,11 @@ function hain(points) {
     }
 }
 
+// called with a node of each monotone piece (a loop by .next) where set
+hain.monotone = null;
+
 function triangulateMonotone(p) {
+    if (hain.monotone) hain.monotone(p);
     // drawMono(p);
     // drawPoint([p.x, p.y], 'blue');
     // drawPoint([p.next.x, p.next.y], 'red');
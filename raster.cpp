@@ -0,0 +1,188 @@
+/*
+ * raster.cpp
+ *
+ * Fill wedge sequences into an 8-bit coverage mask
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "hain.h"
+
+/* coordinate c in pixels */
+#ifdef FIXED_COORDS
+#define PIXELS(c) ((float)(c) / (1 << FIXED_SHIFT))
+#else
+#define PIXELS(c) ((float)(c))
+#endif
+
+static void addSpan(unsigned char *row, int i0, int i1, int c)
+{
+/* Add c to row[i0 .. i1-1], saturating at 255 */
+    int i = i0, t;
+
+#ifdef __SSE2__
+    __m128i cc = _mm_set1_epi8((char)c);
+
+    for (; i + 16 <= i1; i += 16)
+        _mm_storeu_si128((__m128i*)(row + i),
+                         _mm_adds_epu8(_mm_loadu_si128((__m128i*)(row + i)), cc));
+#endif
+    for (; i < i1; i++) {
+        t = row[i] + c;
+        row[i] = (unsigned char)(t > 255? 255: t);
+    }
+}
+/*-------------------------------------------------------*/
+static void addPixel(unsigned char *row, int i, float f, float w)
+{
+/* Add coverage fraction f of sample weight w to pixel i */
+    int t = row[i] + (int)(f * w + 0.5f);
+    row[i] = (unsigned char)(t > 255? 255: t);
+}
+/*-------------------------------------------------------*/
+static void fillSample(const Mask *m, int k, float xl, float xr)
+{
+/* Fill the span [xl, xr) of sample line k */
+    unsigned char *row;
+    float w;
+    int i0, i1;
+
+    if (m->samples <= 1) { /* pixels whose centre is in the span */
+        i0 = (int)ceilf(xl - 0.5f);
+        i1 = (int)ceilf(xr - 0.5f);
+        if (i0 < 0) i0 = 0;
+        if (i1 > m->width) i1 = m->width;
+        if (i0 < i1) memset(m->mask + (size_t)k * m->stride + i0, 255, i1 - i0);
+        return;
+    }
+
+    if (xl < 0) xl = 0;
+    if (xr > m->width) xr = (float)m->width;
+    if (xl >= xr) return;
+    row = m->mask + (size_t)(k / m->samples) * m->stride;
+    w = 255.0f / m->samples;
+    i0 = (int)xl;
+    i1 = (int)xr;
+    if (i0 == i1) { /* span within one pixel */
+        addPixel(row, i0, xr - xl, w);
+        return;
+    }
+    addPixel(row, i0, i0 + 1 - xl, w);
+    addSpan(row, i0 + 1, i1, (int)(w + 0.5f));
+    if (i1 < m->width) addPixel(row, i1, xr - i1, w);
+}
+/*-------------------------------------------------------*/
+static void fillWedge(const Mask *m, float xl, float xr, float lSlope, float rSlope,
+                      float yt, float yb)
+{
+/* Fill the wedge from yt down to yb whose sides go down from xl and xr */
+    int k, k0, k1, S = (m->samples > 1)? m->samples: 1;
+    float y;
+
+    /* sample lines k at y = (k + 0.5)/S with yb <= y < yt */
+    k0 = (int)ceilf(yb * S - 0.5f);
+    k1 = (int)ceilf(yt * S - 0.5f);
+    if (k0 < 0) k0 = 0;
+    if (k1 > m->height * S) k1 = m->height * S;
+    for (k = k0; k < k1; k++) {
+        y = (k + 0.5f) / S;
+        fillSample(m, k, xl - lSlope * (yt - y), xr - rSlope * (yt - y));
+    }
+}
+/*-------------------------------------------------------*/
+void fillWedges(Mask *m, const WedgeSequence *s, const WedgeElement *we)
+{
+/*----------------------------------------------
+ * Add the area of wedge sequence s, with wedge elements we, to mask m.
+ *
+ * Pixel (i, j) is the square [i, i+1) x [j, j+1) of polygon coordinates.
+ * With m->samples <= 1, a pixel is set to 255 if its centre is inside;
+ * otherwise the area of each of m->samples lines across the pixel is
+ * added, giving 255 for a pixel that is fully covered. The sequences of
+ * one polygon do not overlap, so filling them all into a cleared mask
+ * gives the coverage of the polygon.
+ */
+    float xl, xr, lSlope = 0, rSlope = 0, yt, yb;
+    int i, type;
+
+    xl = xr = PIXELS(s->x);
+    yt = PIXELS(s->y);
+    for (i = 0; i < s->numbWe; i++, yt = yb) {
+        type = we[i].wedgeType & ~LAST_WE;
+        if (type != RIGHT) {
+            xl += PIXELS(we[i].lCorr);
+            lSlope = (float)we[i].lSlope;
+        }
+        if (type != LEFT) {
+            xr += PIXELS(we[i].rCorr);
+            rSlope = (float)we[i].rSlope;
+        }
+        yb = yt - PIXELS(we[i].height);
+        fillWedge(m, xl, xr, lSlope, rSlope, yt, yb);
+        xl -= lSlope * PIXELS(we[i].height);
+        xr -= rSlope * PIXELS(we[i].height);
+    }
+}
+/*-------------------------------------------------------*/
+float halfToFloat(unsigned short h)
+{
+/* Value of the 16-bit float h (not infinite or NaN) */
+    unsigned u = (unsigned)(h & 0x8000) << 16, e = (h >> 10) & 0x1f, m = h & 0x3ff;
+    float f;
+
+    if (!e) return (float)m * (1.0f / 16777216) * ((h & 0x8000)? -1: 1); /* subnormal */
+    u |= (e + 112) << 23 | m << 13;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+/*-------------------------------------------------------*/
+void fillStore(Mask *m, const void *store)
+{
+/*----------------------------------------------
+ * Add the area of all wedge sequences of a store written by storeWedges()
+ * to mask m, as fillWedges() does, reading them where they are (such as
+ * in a file mapped by mapStore()).
+ */
+    const StoreHeader *h = (const StoreHeader*)store;
+    const char *p = (const char*)(h + 1);
+    const StoredSequence *s;
+    const unsigned char *types;
+    const float *val;
+    const unsigned short *half;
+    float xl, xr, lSlope, rSlope, yt, yb;
+    unsigned i, k;
+    int halfSlopes = h->flags & STORE_HALF_SLOPES;
+
+    for (k = 0; k < h->numbWs; k++, p += s->size) {
+        s = (const StoredSequence*)p;
+        types = (const unsigned char*)(s + 1);
+        val = (const float*)(types + ((s->numbWe + 3) & ~3u));
+        half = (const unsigned short*)(val + s->numbValues);
+        xl = xr = s->x;
+        yt = s->y;
+        lSlope = rSlope = 0;
+        for (i = 0; i < s->numbWe; i++, yt = yb) {
+            yb = yt - *val++;
+            if (types[i] != RIGHT) {
+                xl += *val++;
+                lSlope = halfSlopes? halfToFloat(*half++): *val++;
+            }
+            if (types[i] != LEFT) {
+                xr += *val++;
+                rSlope = halfSlopes? halfToFloat(*half++): *val++;
+            }
+            fillWedge(m, xl, xr, lSlope, rSlope, yt, yb);
+            xl -= lSlope * (yt - yb);
+            xr -= rSlope * (yt - yb);
+        }
+    }
+}
+/*-------------------------------------------------------*/
+int maskSink(void *m, const WedgeSequence *s, const WedgeElement *we)
+{
+/* WedgeSink that fills each wedge sequence into the Mask m */
+    fillWedges((Mask*)m, s, we);
+    return 0;
+}
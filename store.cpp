@@ -0,0 +1,244 @@
+/*
+ * store.cpp
+ *
+ * Save wedge sequences in a compact form that is read in place
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hain.h"
+
+/* coordinate c in pixels, as fillWedges() takes it */
+#ifdef FIXED_COORDS
+#define PIXELS(c) ((double)(c) / (1 << FIXED_SHIFT))
+#else
+#define PIXELS(c) ((double)(c))
+#endif
+
+static unsigned short floatToHalf(float f)
+{
+/* Nearest 16-bit float to f, saturating at +-65504 */
+    unsigned u, sign, m, shift, rest;
+
+    memcpy(&u, &f, sizeof(u));
+    sign = (u >> 16) & 0x8000;
+    u &= 0x7fffffff;
+    if (u > 0x477fe000) return (unsigned short)(sign | 0x7bff);
+    if (u < 0x38800000) { /* subnormal, in units of 2^-24 */
+        if (u < 0x33000000) return (unsigned short)sign;
+        m = (u & 0x7fffff) | 0x800000;
+        shift = 126 - (u >> 23);
+        rest = m & ((1u << shift) - 1);
+        m >>= shift;
+        if (rest > 1u << (shift - 1) || (rest == 1u << (shift - 1) && (m & 1))) m++;
+        return (unsigned short)(sign | m);
+    }
+    u += 0xfff + ((u >> 13) & 1); /* round to nearest even */
+    return (unsigned short)(sign | ((u - 0x38000000) >> 13));
+}
+/*-------------------------------------------------------*/
+static unsigned sequenceSize(const WedgeSequence *s, const WedgeElement *we, unsigned flags,
+                             unsigned *numbValues)
+{
+/* Bytes that wedge sequence s takes in a store, and its 32-bit values */
+    int i, type;
+    unsigned sides = 0;
+
+    for (i = 0; i < s->numbWe; i++) {
+        type = we[i].wedgeType & ~LAST_WE;
+        sides += (type != RIGHT) + (type != LEFT);
+    }
+    *numbValues = s->numbWe + ((flags & STORE_HALF_SLOPES)? sides: 2*sides);
+    return sizeof(StoredSequence) + ((s->numbWe + 3) & ~3u) + 4 * *numbValues +
+           ((flags & STORE_HALF_SLOPES)? (2*sides + 3) & ~3u: 0);
+}
+/*-------------------------------------------------------*/
+size_t storeWedges(const FillContext *fc, unsigned flags, void *buf, size_t bufSize)
+{
+/*----------------------------------------------
+ * Write the wedge sequences of fc, decomposed without a sink, into buf
+ * in the format of StoreHeader if they fit in its bufSize bytes.
+ *
+ * The reader (fillStore) goes down a sequence in 32-bit floats, so each
+ * correction written is from where the reader will be to where the wedge
+ * really starts, and the error does not grow down a long sequence. With
+ * STORE_HALF_SLOPES, each side of a wedge takes 2 bytes less, and is off
+ * by up to 2^-11 of its change in x over the wedge (or more if its slope
+ * is beyond the 65504 of a 16-bit float).
+ * Returns the size of the store, whether or not it was written.
+ */
+    const WedgeSequence *w;
+    const WedgeElement *we;
+    StoreHeader *h = (StoreHeader*)buf;
+    StoredSequence *s;
+    unsigned char *types;
+    float *val;
+    unsigned short *half;
+    double xlTrue, xrTrue, yTrue, lTrue, rTrue; /* where the wedge really is, its slopes */
+    float xl, xr, yt, yb, lSlope, rSlope; /* where the reader will be */
+    size_t size = sizeof(StoreHeader);
+    unsigned numbValues;
+    int i, k, type;
+
+    for (k = 0; k < fc->numbWs; k++)
+        size += sequenceSize(fc->ws + k, fc->we + fc->ws[k].firstWe, flags, &numbValues);
+    if (!buf || bufSize < size) return size;
+
+    memcpy(h->magic, "HAIN", 4);
+    h->version = STORE_VERSION;
+    h->flags = flags;
+    h->numbWs = fc->numbWs;
+    h->size = size;
+    s = (StoredSequence*)(h + 1);
+    for (k = 0; k < fc->numbWs; k++) {
+        w = fc->ws + k;
+        we = fc->we + w->firstWe;
+        s->size = sequenceSize(w, we, flags, &s->numbValues);
+        s->x = (float)PIXELS(w->x);
+        s->y = (float)PIXELS(w->y);
+        s->pwidth = (float)PIXELS(w->pwidth);
+        s->pht = (float)PIXELS(w->pht);
+        s->numbWe = w->numbWe;
+        types = (unsigned char*)(s + 1);
+        val = (float*)(types + ((w->numbWe + 3) & ~3u));
+        half = (unsigned short*)(val + s->numbValues);
+        memset(types + w->numbWe, 0, (char*)val - (char*)(types + w->numbWe));
+
+        xlTrue = xrTrue = PIXELS(w->x);
+        yTrue = PIXELS(w->y);
+        xl = xr = s->x;
+        yt = s->y;
+        lSlope = rSlope = 0;
+        lTrue = rTrue = 0;
+        for (i = 0; i < w->numbWe; i++, yt = yb) {
+            type = we[i].wedgeType & ~LAST_WE;
+            types[i] = (unsigned char)type;
+            yTrue -= PIXELS(we[i].height);
+            *val = (float)(yt - yTrue);
+            yb = yt - *val++;
+            if (type != RIGHT) {
+                xlTrue += PIXELS(we[i].lCorr);
+                lTrue = we[i].lSlope;
+                *val = (float)(xlTrue - xl);
+                xl += *val++;
+                if (flags & STORE_HALF_SLOPES) {
+                    *half = floatToHalf((float)we[i].lSlope);
+                    lSlope = halfToFloat(*half++);
+                }
+                else lSlope = *val++ = (float)we[i].lSlope;
+            }
+            if (type != LEFT) {
+                xrTrue += PIXELS(we[i].rCorr);
+                rTrue = we[i].rSlope;
+                *val = (float)(xrTrue - xr);
+                xr += *val++;
+                if (flags & STORE_HALF_SLOPES) {
+                    *half = floatToHalf((float)we[i].rSlope);
+                    rSlope = halfToFloat(*half++);
+                }
+                else rSlope = *val++ = (float)we[i].rSlope;
+            }
+            xlTrue -= lTrue * PIXELS(we[i].height);
+            xrTrue -= rTrue * PIXELS(we[i].height);
+            xl -= lSlope * (yt - yb);
+            xr -= rSlope * (yt - yb);
+        }
+        if ((char*)half < (char*)s + s->size) *half = 0; /* padding */
+        s = (StoredSequence*)((char*)s + s->size);
+    }
+    return size;
+}
+/*-------------------------------------------------------*/
+int checkStore(const void *data, size_t size)
+{
+/*----------------------------------------------
+ * Check that the size bytes at data are a store that fillStore() can
+ * read, going through all its sequences; for stores that may have been
+ * damaged or come from elsewhere, as mapStore() only checks the header.
+ * Returns the number of wedge sequences, or -1 if it is not valid.
+ */
+    const StoreHeader *h = (const StoreHeader*)data;
+    const StoredSequence *s;
+    const unsigned char *types;
+    size_t at = sizeof(StoreHeader), need;
+    unsigned i, k, sides;
+
+    if (size < sizeof(StoreHeader) || memcmp(h->magic, "HAIN", 4) ||
+        h->version != STORE_VERSION || (h->flags & ~STORE_HALF_SLOPES) || h->size != size)
+        return -1;
+    for (k = 0; k < h->numbWs; k++, at += s->size) {
+        if (size - at < sizeof(StoredSequence)) return -1;
+        s = (const StoredSequence*)((const char*)data + at);
+        need = sizeof(StoredSequence) + (((size_t)s->numbWe + 3) & ~(size_t)3);
+        if (s->size % 4 || s->size < need || s->size > size - at) return -1;
+        types = (const unsigned char*)(s + 1);
+        for (i = sides = 0; i < s->numbWe; i++) {
+            if (types[i] > BOTH) return -1;
+            sides += (types[i] != RIGHT) + (types[i] != LEFT);
+        }
+        if (s->numbValues != s->numbWe + ((h->flags & STORE_HALF_SLOPES)? sides: 2*sides))
+            return -1;
+        need += 4 * (size_t)s->numbValues + ((h->flags & STORE_HALF_SLOPES)? (2*sides + 3) & ~3u: 0);
+        if (s->size != need) return -1;
+    }
+    return at == size? (int)h->numbWs: -1;
+}
+/*-------------------------------------------------------*/
+int writeStore(const char *path, const FillContext *fc, unsigned flags)
+{
+/* Save the wedge sequences of fc to the file path (see storeWedges).
+ * Returns 0, or -1 if out of memory or the file cannot be written. */
+    size_t size = storeWedges(fc, flags, NULL, 0);
+    void *buf = malloc(size);
+    FILE *f;
+    int status = -1;
+
+    if (!buf) return -1;
+    storeWedges(fc, flags, buf, size);
+    f = fopen(path, "wb");
+    if (f) {
+        if (fwrite(buf, 1, size, f) == size) status = 0;
+        if (fclose(f)) status = -1;
+    }
+    free(buf);
+    return status;
+}
+/*-------------------------------------------------------*/
+const void *mapStore(const char *path, size_t *size)
+{
+/*----------------------------------------------
+ * Map the store saved to the file path into memory, read only, to be
+ * given to fillStore() as it is, and set *size to its size. Only the
+ * header is checked (see checkStore).
+ * Returns NULL if the file cannot be mapped or is not a store.
+ */
+    struct stat st;
+    const StoreHeader *h;
+    void *p;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(StoreHeader)) {
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    p = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    h = (const StoreHeader*)p;
+    if (memcmp(h->magic, "HAIN", 4) || h->version != STORE_VERSION || h->size != *size) {
+        munmap(p, *size);
+        return NULL;
+    }
+    return p;
+}
+/*-------------------------------------------------------*/
+void unmapStore(const void *data, size_t size)
+{
+/* Unmap a store mapped by mapStore() */
+    munmap((void*)data, size);
+}
@@ -173,21 +173,10 @@ function lowerEdge(edges, p) {
 }
 
 function removeEdge(edges, edge) {
-
-    var i = 0,
-        j = edges.length - 1;
-
-    while (i <= j) {
-        var mid = Math.floor((i + j) / 2);
-
-        if (edge === edges[mid]) {
-            edges.splice(mid, 1);
-            return;
-        }
-
-        if (compareEdges(edge, edges[mid])) j = mid - 1;
-        else i = mid + 1;
-    }
+    // found by identity: compareEdges() places an edge by its start, which
+    // the sweep has passed by the time it is removed
+    var i = edges.indexOf(edge);
+    if (i >= 0) edges.splice(i, 1);
 }
 
 function compareEdges(e1, e2) {